@@ -87,6 +87,52 @@ _csv_load_params_doc = """
         A list of column names that should be treated as numeric
         regardless of its inferred type.
 
+    dtypes : dict
+        A mapping from column names to the numpy dtypes in which they
+        are stored, e.g. {'id': 'int32', 'price': 'float64'}. Such a
+        column is numeric, and its values are converted to the dtype as
+        they are parsed instead of inferring the narrowest type that
+        holds them. Floats in integer columns are truncated toward zero,
+        and a value that is out of range for the dtype, or is not a
+        number, raises an error. Empty fields and NaN markers ('nan',
+        '?') are 0 in integer columns and NaN in float columns.
+        (default=None)
+
+    usecols : sequence
+        The columns to load, given by name or by position in the file.
+        The fields of the other columns are skipped without being
+        parsed, and the columns are returned in the order of the file.
+        (default=None, which loads every column)
+
+    filters : sequence
+        The rows to keep, as a list of ``(column_name, op, value)``
+        tuples that must all hold, or a list of such lists of which any
+        must hold. ``op`` is one of '==', '!=', '<', '<=', '>' or '>='.
+        A numeric ``value`` is compared with the fields that are
+        numbers, and a string ``value`` is compared with the text of the
+        fields byte by byte. The other rows are dropped while parsing.
+        (default=None, which keeps every row)
+
+    skiprows : int
+        The number of rows after the header to skip. Skipped rows are
+        only tokenized, not parsed. (default=0)
+
+    nrows : int
+        The maximum number of rows to load. If set, the file is parsed
+        on one thread from the start and reading stops as soon as
+        ``nrows`` rows have been loaded, so the time taken does not
+        depend on the size of the file. With ``filters``, only the rows
+        kept count. (default=None, which loads every row)
+
+    schema_samples : int
+        The number of blocks, spread over the file, that are parsed
+        before the main parse to infer the type of each column. Fields
+        of the inferred type are then parsed without full type
+        detection. This affects only the speed of loading, never the
+        result. Files smaller than 16 * ``schema_samples`` *
+        ``block_size`` bytes are not sampled. 0 disables sampling.
+        (default=8)
+
     in_encoding : str
         The encoding of the data read from the file. (default=None)
 
@@ -98,9 +144,106 @@ _csv_load_params_doc = """
 
     convert_null_to_space : bool
         Whether to convert null terminator characters to spaces. (default=False)
+
+    io_method : str
+        How parser threads read the file. If 'buffered', each thread copies
+        blocks of ``block_size`` bytes into its own buffer. If 'mmap', each
+        thread parses a memory-mapped view of its chunk in place, which
+        avoids a copy when the file is already in the page cache. If
+        'async', each thread parses one block while the next few blocks
+        are read by a shared pool of reader threads, which keeps slow
+        storage busy. If
+        'direct', the file is read around the page cache (O_DIRECT), which
+        suits huge files that are read once. (default='buffered')
+
+    float_precision : str
+        How floating point columns are stored. If 'float32', every value
+        is rounded to single precision. If 'lossless', a column stays in
+        single precision only if all of its values are exact in it, and
+        is returned as float64 otherwise. If 'float64', floating point
+        columns are always returned as float64. Integers are never
+        rounded. (default='float32')
+
+    delimiter : str
+        The character that separates fields: ',', '\\t', '|' or ';'.
+        (default=',')
+
+    escape_style : str
+        How quotes are escaped inside quoted fields. If 'backslash', a
+        quote is written as \\" and backslash escapes such as \\n are
+        decoded. If 'doubled', a quote is written as "" as in RFC 4180,
+        and backslashes are ordinary characters. (default='backslash')
 """
 
-def _get_params(num_threads=0, allow_quoted_newlines=False, block_size=32768, number_only=False, no_header=False, max_level_name_length=None, max_levels=None, convert_null_to_space=True):
+_io_methods = {"buffered": pti.BUFFERED_READ,
+               "mmap": pti.MEMORY_MAPPED,
+               "async": pti.ASYNC_READ,
+               "direct": pti.DIRECT_READ}
+
+def _get_io_method(io_method):
+    if io_method not in _io_methods:
+        raise ValueError("invalid io_method: %s" % io_method)
+    return _io_methods[io_method]
+
+_float_precisions = {"float32": pti.FLOAT32_ALWAYS,
+                     "lossless": pti.FLOAT32_IF_LOSSLESS,
+                     "float64": pti.FLOAT64_ALWAYS}
+
+def _get_float_precision(float_precision):
+    if float_precision not in _float_precisions:
+        raise ValueError("invalid float_precision: %s" % float_precision)
+    return _float_precisions[float_precision]
+
+_escape_styles = {"backslash": pti.BACKSLASH_ESCAPE,
+                  "doubled": pti.DOUBLED_QUOTE_ESCAPE}
+
+def _get_escape_style(escape_style):
+    if escape_style not in _escape_styles:
+        raise ValueError("invalid escape_style: %s" % escape_style)
+    return _escape_styles[escape_style]
+
+def _get_delimiter(delimiter):
+    if delimiter not in (",", "\t", "|", ";"):
+        raise ValueError("invalid delimiter: %r" % delimiter)
+    return delimiter
+
+_storage_types = {"uint8": pti.UINT8_TYPE,
+                  "int8": pti.INT8_TYPE,
+                  "uint16": pti.UINT16_TYPE,
+                  "int16": pti.INT16_TYPE,
+                  "uint32": pti.UINT32_TYPE,
+                  "int32": pti.INT32_TYPE,
+                  "uint64": pti.UINT64_TYPE,
+                  "int64": pti.INT64_TYPE,
+                  "float32": pti.FLOAT32_TYPE,
+                  "float64": pti.FLOAT64_TYPE}
+
+def _get_storage_type(dtype):
+    name = np.dtype(dtype).name
+    if name not in _storage_types:
+        raise ValueError("unsupported dtype: %s" % name)
+    return _storage_types[name]
+
+_comparisons = {"==": pti.EQUAL_TO,
+                "!=": pti.NOT_EQUAL_TO,
+                "<": pti.LESS_THAN,
+                "<=": pti.LESS_EQUAL,
+                ">": pti.GREATER_THAN,
+                ">=": pti.GREATER_EQUAL}
+
+def _add_filters(loader, filters, encoder):
+    if len(filters) > 0 and isinstance(filters[0], tuple):
+        filters = [filters]
+    for conjunction, comparisons in enumerate(filters):
+        for (name, op, value) in comparisons:
+            if op not in _comparisons:
+                raise ValueError("invalid filter operator: %s" % op)
+            if isinstance(value, six.string_types):
+                loader.filter_rows_by_text(encoder(name), _comparisons[op], encoder(value), conjunction)
+            else:
+                loader.filter_rows(encoder(name), _comparisons[op], float(value), conjunction)
+
+def _get_params(num_threads=0, allow_quoted_newlines=False, block_size=32768, number_only=False, no_header=False, max_level_name_length=None, max_levels=None, convert_null_to_space=True, io_method="buffered", float_precision="float32", delimiter=",", escape_style="backslash", schema_samples=8):
     params = pti.ParseParams()
     params.allow_quoted_newlines = allow_quoted_newlines
     if num_threads > 0:
@@ -114,6 +257,11 @@ def _get_params(num_threads=0, allow_quoted_newlines=False, block_size=32768, nu
         params.max_levels = max_levels;
     if max_level_name_length is not None:
         params.max_level_name_length = max_level_name_length
+    params.io_method = _get_io_method(io_method)
+    params.float_precision = _get_float_precision(float_precision)
+    params.delimiter = _get_delimiter(delimiter)
+    params.escape_style = _get_escape_style(escape_style)
+    params.num_schema_samples = schema_samples
     return params
 
 def _make_posix_filename(fn_or_uri):
@@ -131,7 +279,7 @@ def _make_posix_filename(fn_or_uri):
      return result
 
 @_docstring_parameter(_csv_load_params_doc)
-def internal_create_csv_loader(filename, num_threads=0, allow_quoted_newlines=False, block_size=32768, number_only=False, no_header=False, max_level_name_length=None, max_levels=None, cat_names=None, text_names=None, num_names=None, in_encoding=None, out_encoding=None, convert_null_to_space=True):
+def internal_create_csv_loader(filename, num_threads=0, allow_quoted_newlines=False, block_size=32768, number_only=False, no_header=False, max_level_name_length=None, max_levels=None, cat_names=None, text_names=None, num_names=None, in_encoding=None, out_encoding=None, convert_null_to_space=True, io_method="buffered", float_precision="float32", delimiter=",", escape_style="backslash", dtypes=None, usecols=None, filters=None, skiprows=0, nrows=None, schema_samples=8):
     """
     Creates a ParaText internal C++ CSV reader object and reads the CSV
     file in parallel. This function ordinarily should not be called directly.
@@ -161,6 +309,14 @@ def internal_create_csv_loader(filename, num_threads=0, allow_quoted_newlines=Fa
         params.max_levels = max_levels;
     if max_level_name_length is not None:
         params.max_level_name_length = max_level_name_length
+    params.io_method = _get_io_method(io_method)
+    params.float_precision = _get_float_precision(float_precision)
+    params.delimiter = _get_delimiter(delimiter)
+    params.escape_style = _get_escape_style(escape_style)
+    params.skip_rows = skiprows
+    params.num_schema_samples = schema_samples
+    if nrows is not None:
+        params.max_rows = nrows
     if six.PY2:
         encoder = lambda x: x.encode("utf-8")
     else:
@@ -177,6 +333,17 @@ def internal_create_csv_loader(filename, num_threads=0, allow_quoted_newlines=Fa
         for name in text_names:
             name = encoder(name)
             loader.force_semantics(name, pti.TEXT)
+    if dtypes is not None:
+        for name, dtype in dtypes.items():
+            loader.force_type(encoder(name), _get_storage_type(dtype))
+    if usecols is not None:
+        for col in usecols:
+            if isinstance(col, six.integer_types):
+                loader.select_column_index(col)
+            else:
+                loader.select_column(encoder(col))
+    if filters is not None:
+        _add_filters(loader, filters, encoder)
     if in_encoding is not None and in_encoding not in ("utf-8", "unknown"):
         raise ValueError("invalid encoding: " % in_encoding)
     if out_encoding is not None and out_encoding not in ("utf-8", "unknown"):
@@ -402,6 +569,25 @@ def load_csv_to_pandas(filename, *args, **kwargs):
     else:
          return pandas.DataFrame.from_items(expanded)
 
+@_docstring_parameter(_csv_load_params_doc)
+def peek_csv(filename, nrows=5, *args, **kwargs):
+    """
+    Loads the first rows of a CSV file into a pandas DataFrame without
+    reading the rest of the file. It is ``load_csv_to_pandas`` with
+    ``nrows`` defaulting to 5.
+
+    Parameters
+    ----------
+    {0}
+
+    Returns
+    -------
+    d : pandas.DataFrame
+        The first ``nrows`` rows of the CSV file.
+    """
+    kwargs["nrows"] = nrows
+    return load_csv_to_pandas(filename, *args, **kwargs)
+
 @_docstring_parameter(_csv_load_params_doc)
 def baseline_average_columns(filename, type_check=False, *args, **kwargs):
     """
@@ -469,3 +655,23 @@ def baseline_disk_to_mem(filename, *args, **kwargs):
     mc = pti.MemCopyBaseline();
     count = mc.load(_make_posix_filename(filename), params)
     return count
+
+def set_thread_pool_size(num_threads):
+    """
+    Sets the number of worker threads in the process-wide pool that all
+    loads share. By default there is one thread per core. The ``num_threads``
+    option of a load still sets how many chunks it parses at once; the pool
+    bounds how many threads run across all loads in the process.
+
+    Parameters
+    ----------
+    num_threads : int
+        The number of threads in the pool.
+    """
+    pti.set_thread_pool_size(num_threads)
+
+def get_thread_pool_size():
+    """
+    Returns the number of worker threads in the process-wide pool.
+    """
+    return pti.get_thread_pool_size()
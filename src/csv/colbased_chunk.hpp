@@ -29,10 +29,15 @@
 
 #include "generic/parse_params.hpp"
 #include "util/widening_vector.hpp"
+#include "util/string_arena.hpp"
 #include "util/strings.hpp"
+#include "util/token_classifier.hpp"
 
 #include <typeindex>
 #include <sstream>
+#include <memory>
+#include <algorithm>
+#include <cmath>
 
 namespace ParaText {
 
@@ -46,7 +51,7 @@ namespace CSV {
     /*
       Creates a new chunk with an empty name.
      */
-    ColBasedChunk() : max_level_name_length_(std::numeric_limits<size_t>::max()), max_levels_(std::numeric_limits<size_t>::max()), forced_semantics_(Semantics::UNKNOWN) {}
+    ColBasedChunk() : max_level_name_length_(std::numeric_limits<size_t>::max()), max_levels_(std::numeric_limits<size_t>::max()), forced_semantics_(Semantics::UNKNOWN), float_precision_(FloatPrecision::FLOAT32_ALWAYS), storage_type_(StorageType::INFERRED_TYPE), storage_integral_(false), expected_size_(0), num_pending_(0), pending_floats_active_(false) {}
 
     /*
       Creates a new chunk.
@@ -54,7 +59,7 @@ namespace CSV {
       \param column_name      The name of the column for the chunk.
      */
     ColBasedChunk(const std::string &column_name)
-      : column_name_(column_name), max_level_name_length_(std::numeric_limits<size_t>::max()), max_levels_(std::numeric_limits<size_t>::max()), forced_semantics_(Semantics::UNKNOWN) {}
+      : column_name_(column_name), max_level_name_length_(std::numeric_limits<size_t>::max()), max_levels_(std::numeric_limits<size_t>::max()), forced_semantics_(Semantics::UNKNOWN), float_precision_(FloatPrecision::FLOAT32_ALWAYS), storage_type_(StorageType::INFERRED_TYPE), storage_integral_(false), expected_size_(0), num_pending_(0), pending_floats_active_(false) {}
 
     /*
       Creates a new chunk.
@@ -64,9 +69,18 @@ namespace CSV {
                                      column are considered text rather than categorical levels.
       \param max_levels              If this number of levels is exceeded, then all string fields
                                      in a column are considered categorical.
+      \param float_precision         Whether floating point values are rounded to single precision.
+      \param storage_type            The type in which numbers are stored. Unless it is
+                                     INFERRED_TYPE, the column is numeric and every value
+                                     is converted to this type rather than widened.
      */
-    ColBasedChunk(const std::string &column_name, size_t max_level_name_length, size_t max_levels, Semantics forced_semantics_)
-      : column_name_(column_name), max_level_name_length_(max_level_name_length), max_levels_(max_levels), forced_semantics_(forced_semantics_) {}
+    ColBasedChunk(const std::string &column_name, size_t max_level_name_length, size_t max_levels, Semantics forced_semantics, FloatPrecision float_precision = FloatPrecision::FLOAT32_ALWAYS, StorageType storage_type = StorageType::INFERRED_TYPE)
+      : column_name_(column_name), max_level_name_length_(max_level_name_length), max_levels_(max_levels), forced_semantics_(forced_semantics), float_precision_(float_precision), storage_type_(storage_type), storage_integral_(false), expected_size_(0), num_pending_(0), pending_floats_active_(false) {
+      if (storage_type_ != StorageType::INFERRED_TYPE) {
+        forced_semantics_ = Semantics::NUMERIC;
+        set_storage_type();
+      }
+    }
 
 
     /*
@@ -79,13 +93,23 @@ namespace CSV {
      * data was previously passed to this handler, this datum will be converted
      * to a string and treated as categorical.
      */
-    void process_float(float val)               {
-      if (cat_data_.size() > 0 || forced_semantics_ == Semantics::CATEGORICAL || forced_semantics_ == Semantics::TEXT) {
-        std::string s(std::to_string(val));
+    void process_float(double val)               {
+      if (rounds_to_float()) {
+        val = (float)val;
+      }
+      if (has_cat_data() || forced_semantics_ == Semantics::CATEGORICAL || forced_semantics_ == Semantics::TEXT) {
+        std::string s(format_double(val, rounds_to_float()));
         process_categorical(s.begin(), s.end());
       }
+      else if (val != val && storage_integral_) {
+        push_integer(0);
+      }
       else {
-        number_data_.push_back(val);
+        if (num_pending_ == max_pending || !pending_floats_active_) {
+          append_pending();
+          pending_floats_active_ = true;
+        }
+        get_pending().floats[num_pending_++] = val;
       }
     }
 
@@ -95,12 +119,31 @@ namespace CSV {
      * to a string and treated as categorical.
      */
     void process_integer(long long val)               {
-      if (cat_data_.size() > 0 || forced_semantics_ == Semantics::CATEGORICAL || forced_semantics_ == Semantics::TEXT) {
+      if (has_cat_data() || forced_semantics_ == Semantics::CATEGORICAL || forced_semantics_ == Semantics::TEXT) {
         std::string s(std::to_string(val));
         process_categorical(s.begin(), s.end());
       }
       else {
-        number_data_.push_back(val);
+        push_integer(val);
+      }
+    }
+
+    /*
+     * Passes an integer too large for a long long to the column handler.
+     */
+    void process_unsigned_integer(unsigned long long val)               {
+      if (has_cat_data() || forced_semantics_ == Semantics::CATEGORICAL || forced_semantics_ == Semantics::TEXT) {
+        std::string s(std::to_string(val));
+        process_categorical(s.begin(), s.end());
+      }
+      else {
+        append_pending();
+        try {
+          number_data_.push_back(val);
+        }
+        catch (const std::logic_error &e) {
+          throw_in_column(e);
+        }
       }
     }
 
@@ -108,38 +151,68 @@ namespace CSV {
      * Passes a categorical datum to the column handler. If numerical data
      * was previously passed to this handler, all previous data passed will
      * be converted to a string.
+     *
+     * An empty datum is a missing value. While the column is numeric, a
+     * zero is stored in its place, so that the type of the column is
+     * inferred from the other values, and its index is kept; it is read
+     * as NaN from a floating point column and as 0 from an integral one.
+     * It is an empty string if the column is, or later becomes,
+     * categorical or text.
      */
     template <class Iterator>
     void process_categorical(Iterator begin, Iterator end) {
       if (forced_semantics_ == Semantics::NUMERIC) {
-        number_data_.push_back((float)bsd_strtod(begin, end));
+        if (storage_type_ != StorageType::INFERRED_TYPE) {
+          process_declared_number(begin, end);
+        }
+        else {
+          process_float(parse_double(begin, end));
+        }
       }
-      else if (number_data_.size() > 0) {
-        if (begin == end) {
-          //std::cout << "{" << std::string(begin, end);
-          number_data_.push_back((long long)0);
+      else if (begin == end && forced_semantics_ == Semantics::UNKNOWN && !has_cat_data() && !has_text_data()) {
+        missing_.push_back(number_data_.size() + num_pending_);
+        if (pending_floats_active_) {
+          process_float(0.0);
         }
         else {
-          //std::cout << "[" << std::string(begin, end);
-          convert_to_cat_or_text();
-          std::string key(begin, end);
-          add_cat_data(key);
+          push_integer(0);
         }
       }
+      else if (num_pending_ > 0 || number_data_.size() > 0) {
+        convert_to_cat_or_text();
+        add_cat_data(begin, end);
+      }
       else {
-        std::string key(begin, end);
-        add_cat_data(key);
+        add_cat_data(begin, end);
       }
     }
 
+    /*
+      Sets the number of values the chunk is expected to hold. Called
+      before parsing; the storage of the column is sized for it once
+      the kind of its values is known. 0 means unknown.
+     */
+    void set_expected_size(size_t expected_size) {
+      expected_size_ = expected_size;
+    }
+
+    /*
+      Appends the numbers passed since the last flush. Called once the
+      chunk is parsed, before any of its data is read.
+     */
+    void flush() {
+      append_pending();
+      pending_.reset();
+    }
+
     /*
       Returns the semantics of this column.
      */
     Semantics get_semantics() const {
-      if (cat_data_.size() > 0) {
+      if (has_cat_data()) {
         return Semantics::CATEGORICAL;
       }
-      else if (text_data_.size() > 0) {
+      else if (has_text_data()) {
         return Semantics::TEXT;
       }
       else {
@@ -151,18 +224,25 @@ namespace CSV {
       Returns the type index of the data in this column.
      */
     std::type_index get_type_index() const {
-      if (cat_data_.size() > 0) {
-        return cat_data_.get_type_index();
-      } else if (text_data_.size() > 0) {
-        return std::type_index(typeid(text_data_));
+      if (has_cat_data()) {
+        return strings_->cat_data.get_type_index();
+      } else if (has_text_data()) {
+        return std::type_index(typeid(strings_->text_data));
       }
       else {
         return number_data_.get_type_index();
       }
     }
 
+    /*
+      Whether any of the numbers in this column is negative.
+     */
+    bool has_negative_numbers() const {
+      return number_data_.has_negative();
+    }
+
     std::type_index get_common_type_index(std::type_index &other) const {
-      if (cat_data_.size() > 0 || other == std::type_index(typeid(std::string))) {
+      if (has_cat_data() || other == std::type_index(typeid(std::string))) {
         return std::type_index(typeid(std::string));
       }
       else {
@@ -177,49 +257,50 @@ namespace CSV {
 
     template <class T, bool Numeric>
     inline typename std::enable_if<std::is_arithmetic<T>::value && !Numeric, T>::type get(size_t i) const {
-      return cat_data_.get<size_t>(i);
+      return strings_->cat_data.get<size_t>(i);
     }
 
     template <class T, bool Numeric>
     inline typename std::enable_if<std::is_same<std::string, T>::value && !Numeric, T>::type get(size_t i) const {
-      return text_data_[i];
+      return strings_->text_data.get(i);
     }
 
     const std::vector<std::string> &get_cat_keys() const {
-      return cat_keys_;
+      static const std::vector<std::string> empty;
+      return strings_ ? strings_->cat_keys : empty;
     }
 
     size_t size() const {
-      if (cat_data_.size() > 0) {
-        return cat_data_.size();
+      if (has_cat_data()) {
+        return strings_->cat_data.size();
       }
       else if (number_data_.size() > 0) {
         return number_data_.size();
       }
       else {
-        return text_data_.size();
+        return strings_ ? strings_->text_data.size() : 0;
       }
     }
 
     void clear() {
+      num_pending_ = 0;
+      pending_.reset();
+      missing_.clear();
       number_data_.clear();
       number_data_.shrink_to_fit();
-      cat_data_.clear();
-      cat_data_.shrink_to_fit();
-      cat_ids_.clear();
-      cat_keys_.clear();
-      cat_keys_.shrink_to_fit();
+      strings_.reset();
     }
 
     size_t get_string(size_t idx) {
-      return cat_data_.get<size_t>(idx);
+      return strings_->cat_data.get<size_t>(idx);
     }
 
     size_t get_string_id(const std::string &key) {
-      auto it = cat_ids_.find(key);
-      if (it == cat_ids_.end()) {
-        std::tie(it, std::ignore) = cat_ids_.insert(std::make_pair(key, cat_ids_.size()));
-        cat_keys_.push_back(key);
+      StringData &strings = get_string_data();
+      auto it = strings.cat_ids.find(key);
+      if (it == strings.cat_ids.end()) {
+        std::tie(it, std::ignore) = strings.cat_ids.insert(std::make_pair(key, strings.cat_ids.size()));
+        strings.cat_keys.push_back(key);
       }
       return it->second;
     }
@@ -229,71 +310,100 @@ namespace CSV {
      * categorical data.
      */
     void convert_to_cat_or_text() {
+      flush();
       if (number_data_.size() > 0) {
         for (size_t i = 0; i < number_data_.size(); i++) {
-          cat_data_.push_back((long long)get_string_id(std::to_string(number_data_.get<float>(i))));
+          get_string_data().cat_data.push_back((long long)get_string_id(format_number(i)));
         }
         number_data_.clear();
         number_data_.shrink_to_fit();
+        missing_.clear();
       }
     }
 
     void convert_to_text() {
+      flush();
       if (number_data_.size() > 0 || forced_semantics_ == Semantics::TEXT) {
+        StringData &strings = get_string_data();
+        strings.text_data.reserve(std::max(expected_size_, number_data_.size()));
         for (size_t i = 0; i < number_data_.size(); i++) {
-          text_data_.push_back(std::to_string(number_data_.get<float>(i)));
+          strings.text_data.push_back(format_number(i));
         }
         number_data_.clear();
         number_data_.shrink_to_fit();
+        missing_.clear();
       }
-      else if (cat_data_.size() > 0) {
-        for (size_t i = 0; i < cat_data_.size(); i++) {
-          text_data_.push_back(cat_keys_[cat_data_.get<long long>(i)]);
+      else if (has_cat_data()) {
+        StringData &strings = *strings_;
+        strings.text_data.reserve(std::max(expected_size_, strings.cat_data.size()));
+        for (size_t i = 0; i < strings.cat_data.size(); i++) {
+          strings.text_data.push_back(strings.cat_keys[strings.cat_data.get<long long>(i)]);
         }
-        cat_data_.clear();
-        cat_data_.shrink_to_fit();
-        cat_ids_.clear();
-        cat_keys_.clear();
-        cat_keys_.shrink_to_fit();
+        strings.cat_data.clear();
+        strings.cat_data.shrink_to_fit();
+        strings.cat_ids.clear();
+        strings.cat_keys.clear();
+        strings.cat_keys.shrink_to_fit();
       }
     }
 
-    void add_cat_data(const std::string &data) {
-      if (forced_semantics_ == Semantics::TEXT || text_data_.size() > 0) {
-        text_data_.push_back(data);
+    template <class Iterator>
+    void add_cat_data(Iterator begin, Iterator end) {
+      StringData &strings = get_string_data();
+      if (forced_semantics_ == Semantics::TEXT || strings.text_data.size() > 0) {
+        strings.text_data.push_back(begin, end);
       }
       else if (forced_semantics_ == Semantics::CATEGORICAL) {
-        cat_data_.push_back((long long)get_string_id(data));
+        strings.cat_data.push_back((long long)get_string_id(std::string(begin, end)));
       }
-      else if (data.size() > max_level_name_length_ || cat_keys_.size() > max_levels_) {
+      else if ((size_t)std::distance(begin, end) > max_level_name_length_ || strings.cat_keys.size() > max_levels_) {
         convert_to_text();
-        text_data_.push_back(data);
+        strings.text_data.push_back(begin, end);
       }
       else {
-        cat_data_.push_back((long long)get_string_id(data));
+        strings.cat_data.push_back((long long)get_string_id(std::string(begin, end)));
       }
     }
 
-    const std::string &get_text(size_t i) const {
-      return text_data_[i];
+    /*
+     * Calls f(begin, end) on the characters of each text value in order.
+     */
+    template <class F>
+    void for_each_text(F f) const {
+      if (strings_) {
+        strings_->text_data.for_each(f);
+      }
     }
 
+    /*
+      Copies the numbers of this column. A missing value is NaN, or 0
+      if T is integral.
+     */
     template <class T>
     void copy_numeric_into(T *out) {
       number_data_.copy_into(out);
+      for (size_t i : missing_) {
+        out[i] = std::numeric_limits<T>::quiet_NaN();
+      }
+    }
+
+    /*
+      The indices of the missing values of a numeric column, in
+      increasing order.
+     */
+    const std::vector<size_t> &get_missing() const {
+      return missing_;
     }
 
     template <class T>
     void copy_cat_into(T *out) {
-      cat_data_.copy_into(out);
+      if (strings_) {
+        strings_->cat_data.copy_into(out);
+      }
     }
 
     size_t get_text_length_sum() const {
-      size_t sum = 0;
-      for (size_t i = 0; i < text_data_.size(); i++) {
-        sum += text_data_[i].size();
-      }
-      return sum;
+      return strings_ ? strings_->text_data.num_bytes() : 0;
     }
 
     template <class T>
@@ -301,16 +411,244 @@ namespace CSV {
       return number_data_.get_sum<T>();
     }
 
+  private:
+    /*
+      The state of a column that has seen strings. Most columns of a
+      wide file are numeric, so it is only allocated once needed.
+     */
+    struct StringData {
+      widening_vector_dynamic<uint8_t, uint8_t, uint16_t, uint32_t, uint64_t>  cat_data;
+      std::unordered_map<std::string, size_t>                                  cat_ids;
+      std::vector<std::string>                                                 cat_keys;
+      string_arena                                                             text_data;
+    };
+
+    StringData &get_string_data() {
+      if (!strings_) {
+        strings_.reset(new StringData());
+        if (forced_semantics_ == Semantics::TEXT) {
+          strings_->text_data.reserve(expected_size_);
+        }
+        else {
+          strings_->cat_data.reserve(expected_size_);
+        }
+      }
+      return *strings_;
+    }
+
+    /*
+      Numbers are passed to number_data_ in runs of one kind, so that
+      the type that holds them is found once per run rather than once
+      per value. The run is only buffered while the chunk is parsed: a
+      file may have many columns, so the buffer is allocated by the
+      first number and freed by flush().
+     */
+    static const size_t max_pending = 32;
+    union PendingNumbers {
+      long long integers[max_pending];
+      double    floats[max_pending];
+    };
+
+    PendingNumbers &get_pending() {
+      if (!pending_) {
+        pending_.reset(new PendingNumbers());
+      }
+      return *pending_;
+    }
+
+    bool has_cat_data() const {
+      return strings_ && strings_->cat_data.size() > 0;
+    }
+
+    bool has_text_data() const {
+      return strings_ && strings_->text_data.size() > 0;
+    }
+
+    /*
+      Passes a field of a column whose storage type is declared. An
+      empty field and a NaN marker are missing values; any other field
+      must be a number the type can hold.
+     */
+    template <class Iterator>
+    void process_declared_number(Iterator begin, Iterator end) {
+      if (begin == end) {
+        process_float(std::numeric_limits<double>::quiet_NaN());
+        return;
+      }
+      const char *first = &*begin;
+      const char *last = first + (end - begin);
+      long long integer_value = 0;
+      unsigned long long unsigned_value = 0;
+      double float_value = 0.0;
+      switch (TokenClassifier::classify(first, last, integer_value, unsigned_value, float_value)) {
+      case SIGNED_INTEGER_TOKEN:
+        process_integer(integer_value);
+        break;
+      case UNSIGNED_INTEGER_TOKEN:
+        process_unsigned_integer(unsigned_value);
+        break;
+      case INTEGER_OVERFLOW_TOKEN:
+        process_float(parse_double(first, last));
+        break;
+      case FLOAT_TOKEN:
+        process_float(float_value);
+        break;
+      case NAN_TOKEN:
+        process_float(std::numeric_limits<double>::quiet_NaN());
+        break;
+      default:
+        {
+          std::ostringstream ostr;
+          ostr << "The value " << std::string(first, last) << " cannot be stored as "
+               << get_type_name(number_data_.get_type_index()) << " in column " << column_name_;
+          throw std::logic_error(ostr.str());
+        }
+      }
+    }
+
+    /*
+      Rethrows an error storing a number with the name of the column.
+     */
+    void throw_in_column(const std::logic_error &e) const {
+      std::ostringstream ostr;
+      ostr << e.what() << " in column " << column_name_;
+      throw std::logic_error(ostr.str());
+    }
+
+    /*
+      Whether floating point numbers are rounded to single precision.
+     */
+    bool rounds_to_float() const {
+      return float_precision_ == FloatPrecision::FLOAT32_ALWAYS && storage_type_ == StorageType::INFERRED_TYPE;
+    }
+
+    /*
+      Formats the i-th number for a column that turns categorical or
+      text, as process_integer(), process_unsigned_integer() and
+      process_float() format the numbers that follow. A missing value
+      is an empty string.
+
+      While rounds_to_float(), a float is rounded to single precision
+      as it is parsed, so an integral double that a float cannot hold
+      was parsed as an integer; it is formatted with all its digits.
+     */
+    std::string format_number(size_t i) const {
+      if (std::binary_search(missing_.begin(), missing_.end(), i)) {
+        return std::string();
+      }
+      const std::type_index idx = number_data_.get_type_index();
+      if (idx == std::type_index(typeid(uint64_t))) {
+        return std::to_string(number_data_.get<unsigned long long>(i));
+      }
+      else if (idx == std::type_index(typeid(float)) || idx == std::type_index(typeid(double))) {
+        const double value = number_data_.get<double>(i);
+        if (rounds_to_float() && value == std::trunc(value) && (double)(float)value != value
+            && value >= -9223372036854775808.0 && value < 18446744073709551616.0) {
+          return value < 0 ? std::to_string((long long)value) : std::to_string((unsigned long long)value);
+        }
+        return format_double(value, rounds_to_float());
+      }
+      else {
+        return std::to_string(number_data_.get<long long>(i));
+      }
+    }
+
+    void push_integer(long long val) {
+      if (num_pending_ == max_pending || pending_floats_active_) {
+        append_pending();
+        pending_floats_active_ = false;
+      }
+      get_pending().integers[num_pending_++] = val;
+    }
+
+    /*
+      Appends the numbers passed since the last call to number_data_,
+      keeping the buffer for the numbers that follow.
+     */
+    void append_pending() {
+      if (num_pending_ == 0) {
+        return;
+      }
+      const size_t n = num_pending_;
+      num_pending_ = 0;
+      if (number_data_.size() == 0 && expected_size_ > 0) {
+        number_data_.reserve(expected_size_);
+      }
+      try {
+        if (pending_floats_active_) {
+          number_data_.append(pending_->floats, pending_->floats + n);
+        }
+        else {
+          number_data_.append(pending_->integers, pending_->integers + n);
+        }
+      }
+      catch (const std::logic_error &e) {
+        throw_in_column(e);
+      }
+    }
+
+    void set_storage_type() {
+      storage_integral_ = true;
+      switch (storage_type_) {
+      case StorageType::UINT8_TYPE:
+        number_data_.set_fixed_type<uint8_t>();
+        break;
+      case StorageType::INT8_TYPE:
+        number_data_.set_fixed_type<int8_t>();
+        break;
+      case StorageType::UINT16_TYPE:
+        number_data_.set_fixed_type<uint16_t>();
+        break;
+      case StorageType::INT16_TYPE:
+        number_data_.set_fixed_type<int16_t>();
+        break;
+      case StorageType::UINT32_TYPE:
+        number_data_.set_fixed_type<uint32_t>();
+        break;
+      case StorageType::INT32_TYPE:
+        number_data_.set_fixed_type<int32_t>();
+        break;
+      case StorageType::UINT64_TYPE:
+        number_data_.set_fixed_type<uint64_t>();
+        break;
+      case StorageType::INT64_TYPE:
+        number_data_.set_fixed_type<int64_t>();
+        break;
+      case StorageType::FLOAT32_TYPE:
+        storage_integral_ = false;
+        number_data_.set_fixed_type<float>();
+        break;
+      default:
+        storage_integral_ = false;
+        number_data_.set_fixed_type<double>();
+        break;
+      }
+    }
+
   private:
     std::string column_name_;
-    widening_vector_dynamic<uint8_t, int8_t, int16_t, int32_t, int64_t, float> number_data_;
-    widening_vector_dynamic<uint8_t, uint8_t, uint16_t, uint32_t, uint64_t>    cat_data_;
-    std::unordered_map<std::string, size_t>                                    cat_ids_;
-    std::vector<std::string>                                                   cat_keys_;
-    std::vector<std::string>                                                   text_data_;
-    size_t                                                                     max_level_name_length_;
-    size_t                                                                     max_levels_;
-    Semantics                                                                  forced_semantics_;
+    widening_vector_dynamic<uint8_t, int8_t, int16_t, int32_t, int64_t, uint64_t, float, double> number_data_;
+    std::unique_ptr<StringData>                                                                  strings_;
+    size_t                                                                                       max_level_name_length_;
+    size_t                                                                                       max_levels_;
+    Semantics                                                                                    forced_semantics_;
+    FloatPrecision                                                                               float_precision_;
+    StorageType                                                                                  storage_type_;
+    bool                                                                                         storage_integral_;
+    size_t                                                                                       expected_size_;
+
+    /*
+      The indices of the missing values, stored as zeros in
+      number_data_, in increasing order.
+     */
+    std::vector<size_t>                                                                          missing_;
+
+    /*
+      The run of numbers not yet passed to number_data_.
+     */
+    std::unique_ptr<PendingNumbers>                                                              pending_;
+    size_t                                                                                       num_pending_;
+    bool                                                                                         pending_floats_active_;
   };
 }
 }
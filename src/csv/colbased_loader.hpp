@@ -29,10 +29,13 @@
 
 #include "generic/parse_params.hpp"
 #include "generic/chunker.hpp"
+#include "generic/dialect.hpp"
+#include "generic/row_filter.hpp"
 
 #include "header_parser.hpp"
 #include "colbased_chunk.hpp"
 #include "colbased_worker.hpp"
+#include "column_block.hpp"
 #include "parallel.hpp"
 
 #include <memory>
@@ -196,7 +199,7 @@ namespace ParaText {
    */
   class ColBasedLoader {
   public:
-    ColBasedLoader() : cached_categorical_column_index_(std::numeric_limits<size_t>::max()), in_encoding_(Encoding::UNKNOWN_BYTES), out_encoding_(Encoding::UNKNOWN_BYTES) {}
+    ColBasedLoader() : cached_categorical_column_index_(std::numeric_limits<size_t>::max()), num_parse_rounds_(0), in_encoding_(Encoding::UNKNOWN_BYTES), out_encoding_(Encoding::UNKNOWN_BYTES), float_precision_(FloatPrecision::FLOAT32_ALWAYS) {}
 
     /*
       Called before .load(). Used to force a type on a column regardless of the type
@@ -206,35 +209,347 @@ namespace ParaText {
       forced_semantics_.insert(std::make_pair(column_name, semantics));
     }
 
+    /*
+      Called before .load(). Declares the type in which a numeric column
+      is stored. Its values are converted to the type as they are
+      parsed, with no inference or widening. A floating point value in
+      an integral column is truncated toward zero; a value outside the
+      range of the type, or a field that is not a number, is an error.
+      An empty field or a NaN marker is stored as zero in an integral
+      column and as NaN in a floating point one.
+     */
+    void force_type(const std::string &column_name, StorageType storage_type) {
+      forced_types_[column_name] = storage_type;
+    }
+
+    /*
+      Called before .load(). Selects a column, by name, to be loaded. If
+      any column is selected, the others are skipped while parsing, and
+      the selected columns are returned in the order of the file.
+     */
+    void select_column(const std::string &column_name) {
+      selected_names_.push_back(column_name);
+    }
+
+    /*
+      Called before .load(). Selects a column, by its position in the
+      file, to be loaded.
+     */
+    void select_column_index(size_t column_index) {
+      selected_indices_.push_back(column_index);
+    }
+
+    /*
+      Called before .load(). Keeps only the rows whose value in a column
+      compares with ``value`` as given. Comparisons with the same
+      ``conjunction`` must all hold, and a row is kept if the comparisons
+      of any conjunction hold. The column need not be selected.
+     */
+    void filter_rows(const std::string &column_name, Comparison comparison, double value, size_t conjunction = 0) {
+      filter_comparisons_.push_back(FilterComparison(column_name, comparison, conjunction));
+      filter_comparisons_.back().numeric = true;
+      filter_comparisons_.back().number = value;
+    }
+
+    /*
+      Called before .load(). Like filter_rows(), but compares the text
+      of the column with a string.
+     */
+    void filter_rows_by_text(const std::string &column_name, Comparison comparison, const std::string &value, size_t conjunction = 0) {
+      filter_comparisons_.push_back(FilterComparison(column_name, comparison, conjunction));
+      filter_comparisons_.back().text = value;
+    }
+
     /*
       Loads a CSV file.
     */
     void       load(const std::string &filename, const ParaText::ParseParams &params) {
-      header_parser_.open(filename, params.no_header);
+      if (params.escape_style == EscapeStyle::DOUBLED_QUOTE_ESCAPE) {
+        load_with_escape_style<EscapeStyle::DOUBLED_QUOTE_ESCAPE>(filename, params);
+      }
+      else {
+        load_with_escape_style<EscapeStyle::BACKSLASH_ESCAPE>(filename, params);
+      }
+    }
+
+  private:
+    /*
+      Loads a file with the delimiter in ``params`` and the escape style
+      ``Escape``. Each supported dialect is a separate instantiation of
+      the parser.
+     */
+    template <EscapeStyle Escape>
+    void load_with_escape_style(const std::string &filename, const ParaText::ParseParams &params) {
+      switch (params.delimiter) {
+      case ',':
+        load_dialect<Dialect<',', Escape> >(filename, params);
+        break;
+      case '\t':
+        load_dialect<Dialect<'\t', Escape> >(filename, params);
+        break;
+      case '|':
+        load_dialect<Dialect<'|', Escape> >(filename, params);
+        break;
+      case ';':
+        load_dialect<Dialect<';', Escape> >(filename, params);
+        break;
+      default:
+        {
+          std::ostringstream ostr;
+          ostr << "unsupported delimiter: '" << params.delimiter << "'";
+          throw std::logic_error(ostr.str());
+        }
+      }
+    }
+
+    /*
+      Loads a file written in the ``Dialect``.
+     */
+    template <class Dialect>
+    void load_dialect(const std::string &filename, const ParaText::ParseParams &params) {
+      header_parser_.open<Dialect>(filename, params.no_header);
       struct stat fs;
       if (stat(filename.c_str(), &fs) == -1) {
         throw std::logic_error("cannot stat file");
       }
       length_ = fs.st_size;
-      column_infos_.resize(header_parser_.get_num_columns());
-      for (size_t i = 0; i < column_infos_.size(); i++) {
-        column_infos_[i].name = header_parser_.get_column_name(i);
-      }
-      if (header_parser_.has_header()) {
-        chunker_.process(filename, header_parser_.get_end_of_header()+1, params.num_threads, params.allow_quoted_newlines);
+      select_columns();
+      build_row_filter();
+      size_t data_begin = header_parser_.has_header() ? header_parser_.get_end_of_header() + 1 : 0;
+      if (params.max_rows != std::numeric_limits<size_t>::max()) {
+        parse_head<Dialect>(filename, data_begin, params);
       }
       else {
-        chunker_.process(filename, 0, params.num_threads, params.allow_quoted_newlines);
+        if (params.skip_rows > 0) {
+          data_begin = skip_records<Dialect>(filename, data_begin, params);
+        }
+        infer_expected_tokens<Dialect>(filename, data_begin, params);
+        num_parse_rounds_ = 1;
+        const size_t num_chunks = std::max((size_t)1, params.num_threads * params.chunks_per_thread);
+        chunker_.process<Dialect>(filename, data_begin, num_chunks, params.allow_quoted_newlines, params.io_method, !params.speculative_quotes);
+        if (params.allow_quoted_newlines && params.speculative_quotes) {
+          spawn_speculative_parse_workers<Dialect>(filename, params);
+        }
+        else {
+          spawn_parse_workers<Dialect>(filename, params);
+        }
+      }
+      float_precision_ = params.float_precision;
+      update_meta_data(params.num_threads);
+    }
+
+    /*
+      Parses at most params.max_rows records, after skipping
+      params.skip_rows, on a single worker that reads the file from
+      ``data_begin`` only as far as it needs to. No chunk offsets are
+      computed, so the time taken does not depend on the file size.
+     */
+    template <class Dialect>
+    void parse_head(const std::string &filename, size_t data_begin, const ParaText::ParseParams &params) {
+      auto block = create_column_handlers(params);
+      ColBasedParseWorker<ColBasedChunk, Dialect> worker(block, selected_, row_filter_);
+      worker.limit_rows(params.skip_rows, params.max_rows);
+      if (data_begin < length_) {
+        worker.parse(filename, data_begin, length_ - 1, data_begin, length_, get_incremental_params(params));
+        if (worker.get_exception()) {
+          std::rethrow_exception(worker.get_exception());
+        }
+      }
+      column_chunks_.clear();
+      column_chunks_.push_back(ColumnBlock<ColBasedChunk>::share(block));
+    }
+
+    /*
+      Returns the parameters for a worker that parses the rest of the
+      file but stops early. A memory-mapped region is populated as a
+      whole when it is mapped, so such a worker reads in blocks instead.
+     */
+    static ParaText::ParseParams get_incremental_params(const ParaText::ParseParams &params) {
+      ParaText::ParseParams incremental(params);
+      if (incremental.io_method == IOMethod::MEMORY_MAPPED) {
+        incremental.io_method = IOMethod::BUFFERED_READ;
+      }
+      return incremental;
+    }
+
+    /*
+      Returns the offset of the record that follows the first
+      params.skip_rows records from ``data_begin``, which are tokenized
+      but not parsed.
+     */
+    template <class Dialect>
+    size_t skip_records(const std::string &filename, size_t data_begin, const ParaText::ParseParams &params) {
+      if (data_begin >= length_) {
+        return data_begin;
+      }
+      ColBasedParseWorker<ColBasedChunk, Dialect> worker(create_column_handlers(params), selected_);
+      worker.limit_rows(params.skip_rows, 0);
+      worker.parse(filename, data_begin, length_ - 1, data_begin, length_, get_incremental_params(params));
+      if (worker.get_exception()) {
+        std::rethrow_exception(worker.get_exception());
+      }
+      return worker.get_next_record_offset();
+    }
+
+    /*
+      Builds the info of the columns to load and marks, for each field of
+      a record, whether it belongs to one of them. Nothing is marked if
+      no column was selected.
+     */
+    void select_columns() {
+      const size_t num_fields = header_parser_.get_num_columns();
+      selected_.clear();
+      if (selected_names_.size() > 0 || selected_indices_.size() > 0) {
+        selected_.resize(num_fields, false);
+        for (size_t i = 0; i < selected_indices_.size(); i++) {
+          if (selected_indices_[i] >= num_fields) {
+            std::ostringstream ostr;
+            ostr << "selected column index " << selected_indices_[i] << " is out of range; the file has " << num_fields << " columns";
+            throw std::logic_error(ostr.str());
+          }
+          selected_[selected_indices_[i]] = true;
+        }
+        for (size_t i = 0; i < selected_names_.size(); i++) {
+          bool found = false;
+          for (size_t field = 0; field < num_fields; field++) {
+            if (header_parser_.get_column_name(field) == selected_names_[i]) {
+              selected_[field] = true;
+              found = true;
+            }
+          }
+          if (!found) {
+            std::ostringstream ostr;
+            ostr << "selected column '" << selected_names_[i] << "' is not in the header";
+            throw std::logic_error(ostr.str());
+          }
+        }
+      }
+      column_infos_.clear();
+      for (size_t field = 0; field < num_fields; field++) {
+        if (selected_.empty() || selected_[field]) {
+          column_infos_.push_back(ColumnInfo());
+          column_infos_.back().name = header_parser_.get_column_name(field);
+        }
+      }
+    }
+
+    /*
+      Infers the kind of token to expect in each field from
+      params.num_schema_samples blocks spread evenly over the data. The
+      workers then parse the tokens of that kind without full
+      classification; any other token is classified as usual, so what
+      is inferred affects only the speed, never the result.
+
+      Each block is parsed like a speculative chunk, and a block whose
+      parse fails is ignored. Nothing is inferred for files too small
+      for the sampling to pay off.
+     */
+    template <class Dialect>
+    void infer_expected_tokens(const std::string &filename, size_t data_begin, const ParaText::ParseParams &params) {
+      typedef ColBasedParseWorker<ColBasedChunk, Dialect> worker_type;
+      expected_tokens_.clear();
+      const size_t num_samples = params.num_schema_samples;
+      const size_t sample_size = params.block_size;
+      if (num_samples == 0 || data_begin >= length_ || length_ - data_begin < 16 * num_samples * sample_size) {
+        return;
+      }
+      const size_t stride = (length_ - data_begin) / num_samples;
+      std::vector<std::shared_ptr<ColumnBlock<ColBasedChunk> > > blocks(num_samples);
+      std::vector<std::shared_ptr<worker_type> > workers(num_samples);
+      for (size_t i = 0; i < num_samples; i++) {
+        blocks[i] = create_column_handlers(params);
+        workers[i] = std::make_shared<worker_type>(blocks[i], selected_);
+      }
+      const QuoteState quote_state = params.allow_quoted_newlines ? QuoteState::UNKNOWN_QUOTE_STATE : QuoteState::OUTSIDE_QUOTES;
+      parallel_for_each_stealing(num_samples, params.num_threads, [&](size_t i, size_t thread_id) {
+          (void)thread_id;
+          const size_t begin = data_begin + i * stride;
+          workers[i]->parse_speculative(filename, begin, begin + sample_size - 1, length_, i == 0, quote_state, params);
+        });
+      const size_t num_fields = header_parser_.get_num_columns();
+      expected_tokens_.assign(num_fields, ExpectedToken::ANY_EXPECTED);
+      size_t column_index = 0;
+      for (size_t field = 0; field < num_fields; field++) {
+        if (!selected_.empty() && !selected_[field]) {
+          continue;
+        }
+        bool any_integers = false, any_floats = false, any_strings = false;
+        for (size_t i = 0; i < num_samples; i++) {
+          const ColBasedChunk &chunk = (*blocks[i])[column_index];
+          if (workers[i]->get_exception() || workers[i]->get_parse_exception() || chunk.size() == 0) {
+            continue;
+          }
+          if (chunk.get_semantics() != Semantics::NUMERIC) {
+            any_strings = true;
+          }
+          else if (chunk.get_type_index() == std::type_index(typeid(float))
+                   || chunk.get_type_index() == std::type_index(typeid(double))) {
+            any_floats = true;
+          }
+          else {
+            any_integers = true;
+          }
+        }
+        if (any_strings) {
+          expected_tokens_[field] = (any_integers || any_floats) ? ExpectedToken::ANY_EXPECTED : ExpectedToken::STRING_EXPECTED;
+        }
+        else if (any_floats) {
+          expected_tokens_[field] = ExpectedToken::FLOAT_EXPECTED;
+        }
+        else if (any_integers) {
+          expected_tokens_[field] = ExpectedToken::INTEGER_EXPECTED;
+        }
+        column_index++;
       }
-      spawn_parse_workers(filename, params);
-      update_meta_data();
     }
 
+    /*
+      Resolves the columns of the filter comparisons to fields.
+     */
+    void build_row_filter() {
+      row_filter_.reset();
+      if (filter_comparisons_.size() == 0) {
+        return;
+      }
+      auto row_filter = std::make_shared<RowFilter>();
+      for (size_t i = 0; i < filter_comparisons_.size(); i++) {
+        const FilterComparison &fc = filter_comparisons_[i];
+        size_t field = 0;
+        for (; field < header_parser_.get_num_columns(); field++) {
+          if (header_parser_.get_column_name(field) == fc.column_name) {
+            break;
+          }
+        }
+        if (field == header_parser_.get_num_columns()) {
+          std::ostringstream ostr;
+          ostr << "filtered column '" << fc.column_name << "' is not in the header";
+          throw std::logic_error(ostr.str());
+        }
+        if (fc.numeric) {
+          row_filter->add_comparison(fc.conjunction, field, fc.comparison, fc.number);
+        }
+        else {
+          row_filter->add_comparison(fc.conjunction, field, fc.comparison, fc.text);
+        }
+      }
+      row_filter_ = row_filter;
+    }
+
+  public:
     /*
       Returns the number of columns parsed by this loader.
      */
     size_t     get_num_columns() const {
-      return column_chunks_.size() == 0 ? header_parser_.get_num_columns() : column_chunks_[0].size();
+      return column_chunks_.size() == 0 ? column_infos_.size() : column_chunks_[0].size();
+    }
+
+    /*
+      Returns the number of times the chunks of the last load were
+      parsed: 2 if a speculative parse guessed the quote state at the
+      start of some chunk wrong, 1 otherwise.
+     */
+    size_t get_num_parse_rounds() const {
+      return num_parse_rounds_;
     }
 
     /*
@@ -332,6 +647,9 @@ namespace ParaText {
 
     void forget_column(size_t column_index) {
       for (size_t worker_id = 0; worker_id < column_chunks_.size(); worker_id++) {
+        if (column_chunks_[worker_id][column_index]) {
+          column_chunks_[worker_id][column_index]->clear();
+        }
         column_chunks_[worker_id][column_index].reset();
       }
       cat_buffer_[column_index].clear();
@@ -424,7 +742,13 @@ namespace ParaText {
     }
 
   private:
-    void update_meta_data() {
+    /*
+      Reconciles the types that the chunks inferred for each column. The
+      columns are scheduled dynamically on at most ``num_threads`` threads,
+      with the columns that need converting to categorical or text, which
+      are expensive, queued ahead of the numeric ones.
+     */
+    void update_meta_data(size_t num_threads) {
       level_names_.clear();
       level_ids_.clear();
       level_names_.resize(get_num_columns());
@@ -453,32 +777,31 @@ namespace ParaText {
       }
       std::vector<size_t> column_indices;
       for (size_t column_index = 0; column_index < column_chunks_[0].size(); column_index++) {
-        column_indices.push_back(column_index);
+        if (!all_numeric_[column_index]) {
+          column_indices.push_back(column_index);
+        }
+      }
+      for (size_t column_index = 0; column_index < column_chunks_[0].size(); column_index++) {
+        if (all_numeric_[column_index]) {
+          column_indices.push_back(column_index);
+        }
       }
       if (all_columns_numeric) {
         for (size_t column_index = 0; column_index < column_chunks_[0].size(); column_index++) {
-          std::type_index idx = column_chunks_[0][column_index]->get_type_index();
-          for (size_t worker_id = 1; worker_id < column_chunks_.size(); worker_id++) {
-            idx = column_chunks_[worker_id][column_index]->get_common_type_index(idx);
-          }
-          common_type_index_[column_index] = idx;
+          common_type_index_[column_index] = get_numeric_type_index(column_index, get_common_chunk_type_index(column_index));
           column_infos_[column_index].semantics = Semantics::NUMERIC;
         }
       }
       else {
         std::exception_ptr thread_exception;
         std::mutex         thread_exception_lock;
-        parallel_for_each(column_indices.begin(), column_indices.end(), column_chunks_[0].size(),
-                          [&](decltype(column_indices.begin()) it, size_t thread_id) mutable {
+        parallel_for_each_stealing(column_indices.size(), num_threads,
+                                   [&](size_t task, size_t thread_id) {
         try {
-          size_t column_index = *it;
+          size_t column_index = column_indices[task];
           (void)thread_id;
           if (all_numeric_[column_index]) {
-            std::type_index idx = column_chunks_[0][column_index]->get_type_index();
-            for (size_t worker_id = 1; worker_id < column_chunks_.size(); worker_id++) {
-              idx = column_chunks_[worker_id][column_index]->get_common_type_index(idx);
-            }
-            common_type_index_[column_index] = idx;
+            common_type_index_[column_index] = get_numeric_type_index(column_index, get_common_chunk_type_index(column_index));
             column_infos_[column_index].semantics = Semantics::NUMERIC;
           }
           else {
@@ -506,6 +829,7 @@ namespace ParaText {
               common_type_index_[column_index] = std::type_index(typeid(uint64_t));
               column_infos_[column_index].semantics = Semantics::CATEGORICAL;
               cat_buffer_[column_index].clear();
+              cat_buffer_[column_index].reserve(size_[column_index]);
               for (size_t worker_id = 0; worker_id < column_chunks_.size(); worker_id++) {
                 const auto &clist = column_chunks_[worker_id][column_index];
                 auto &keys = clist->get_cat_keys();
@@ -536,14 +860,161 @@ namespace ParaText {
     }
 
   private:
+    /*
+      Returns the type that holds the numbers of all chunks of a numeric
+      column. A chunk widens non-negative integers to uint64 when a larger
+      one arrives, so signed chunks whose numbers are all non-negative are
+      merged with uint64 chunks as uint64 too. Otherwise the type would
+      depend on how the file is split into chunks.
+     */
+    std::type_index get_common_chunk_type_index(size_t column_index) const {
+      std::type_index idx = column_chunks_[0][column_index]->get_type_index();
+      for (size_t worker_id = 1; worker_id < column_chunks_.size(); worker_id++) {
+        idx = column_chunks_[worker_id][column_index]->get_common_type_index(idx);
+      }
+      if (idx != std::type_index(typeid(double))) {
+        return idx;
+      }
+      bool any_uint64 = false;
+      for (size_t worker_id = 0; worker_id < column_chunks_.size(); worker_id++) {
+        const auto &chunk = column_chunks_[worker_id][column_index];
+        const std::type_index chunk_idx = chunk->get_type_index();
+        if (chunk_idx == std::type_index(typeid(uint64_t))) {
+          any_uint64 = true;
+        }
+        else if (chunk_idx == std::type_index(typeid(float))
+                 || chunk_idx == std::type_index(typeid(double))
+                 || chunk->has_negative_numbers()) {
+          return idx;
+        }
+      }
+      return any_uint64 ? std::type_index(typeid(uint64_t)) : idx;
+    }
+
+    /*
+      Returns the type a numeric column is returned as, given the common
+      type of its chunks.
+     */
+    std::type_index get_numeric_type_index(size_t column_index, std::type_index idx) const {
+      if (float_precision_ == FloatPrecision::FLOAT64_ALWAYS && idx == std::type_index(typeid(float))
+          && get_forced_type(column_index) == StorageType::INFERRED_TYPE) {
+        return std::type_index(typeid(double));
+      }
+      return idx;
+    }
+
+    /*
+      Returns the type declared for a column, or INFERRED_TYPE.
+     */
+    StorageType get_forced_type(size_t column_index) const {
+      auto it = forced_types_.find(column_infos_[column_index].name);
+      return it == forced_types_.end() ? StorageType::INFERRED_TYPE : it->second;
+    }
+
+    /*
+      Creates a handler for each column of a chunk. The handlers of a
+      chunk share one contiguous block. ``expected_size`` is the number
+      of records the chunk is expected to hold, or 0 if unknown.
+     */
+    std::shared_ptr<ColumnBlock<ColBasedChunk> > create_column_handlers(const ParaText::ParseParams &params, size_t expected_size = 0) const {
+      auto block = std::make_shared<ColumnBlock<ColBasedChunk> >(column_infos_.size());
+      for (size_t col = 0; col < column_infos_.size(); col++) {
+        auto fit = forced_semantics_.find(column_infos_[col].name);
+        const Semantics semantics = fit == forced_semantics_.end() ? Semantics::UNKNOWN : fit->second;
+        block->emplace_back(column_infos_[col].name, params.max_level_name_length, params.max_levels, semantics, params.float_precision, get_forced_type(col));
+        (*block)[col].set_expected_size(expected_size);
+      }
+      return block;
+    }
+
+    /*
+      Parses chunks that were not aligned to records when quoted newlines
+      are allowed. Each worker guesses whether its chunk begins inside a
+      quoted field and counts the quotes in its chunk. The parity of the
+      counts of the preceding chunks then tells which guesses were wrong,
+      and only those chunks are parsed a second time.
+     */
+    template <class Dialect>
+    void spawn_speculative_parse_workers(const std::string &filename, const ParaText::ParseParams &params) {
+      typedef ColBasedParseWorker<ColBasedChunk, Dialect> worker_type;
+      std::vector<std::pair<long long, long long> > chunks;
+      for (size_t worker_id = 0; worker_id < chunker_.num_chunks(); worker_id++) {
+        auto chunk = chunker_.get_chunk(worker_id);
+        if (chunk.first >= 0 && chunk.second >= 0) {
+          chunks.push_back(chunk);
+        }
+      }
+      std::vector<std::shared_ptr<ColumnBlock<ColBasedChunk> > > handlers(chunks.size());
+      std::vector<std::shared_ptr<worker_type> > workers(chunks.size());
+      std::vector<QuoteState> quote_states(chunks.size(), QuoteState::UNKNOWN_QUOTE_STATE);
+      std::vector<size_t> pending;
+      for (size_t i = 0; i < chunks.size(); i++) {
+        pending.push_back(i);
+      }
+      /* The quote counts do not depend on the guess, so a second round is always final. */
+      num_parse_rounds_ = 0;
+      while (pending.size() > 0) {
+        num_parse_rounds_++;
+        std::exception_ptr thread_exception;
+        for (size_t k = 0; k < pending.size(); k++) {
+          const size_t i = pending[k];
+          handlers[i] = create_column_handlers(params);
+          workers[i] = std::make_shared<worker_type>(handlers[i], selected_, row_filter_);
+          if (expected_tokens_.size() > 0) {
+            workers[i]->expect_tokens(expected_tokens_);
+          }
+        }
+        parallel_for_each_stealing(pending.size(), params.num_threads, [&](size_t k, size_t thread_id) {
+            (void)thread_id;
+            const size_t i = pending[k];
+            workers[i]->parse_speculative(filename, chunks[i].first, chunks[i].second, length_, i == 0, quote_states[i], params);
+          });
+        for (size_t k = 0; k < pending.size(); k++) {
+          if (!thread_exception) {
+            thread_exception = workers[pending[k]]->get_exception();
+          }
+        }
+        if (thread_exception) {
+          std::rethrow_exception(thread_exception);
+        }
+        pending.clear();
+        size_t quotes_so_far = 0;
+        for (size_t i = 0; i < workers.size(); i++) {
+          const QuoteState actual = quotes_so_far % 2 == 0 ? QuoteState::OUTSIDE_QUOTES : QuoteState::INSIDE_QUOTES;
+          if (i > 0 && workers[i]->get_quote_state() != actual) {
+            quote_states[i] = actual;
+            pending.push_back(i);
+          }
+          quotes_so_far += workers[i]->get_num_quotes();
+        }
+      }
+      column_chunks_.clear();
+      for (size_t i = 0; i < workers.size(); i++) {
+        if (workers[i]->get_parse_exception()) {
+          std::rethrow_exception(workers[i]->get_parse_exception());
+        }
+        /* Drop chunks in which no record begins. */
+        if (i == 0 || workers[i]->get_num_lines_parsed() > 0) {
+          column_chunks_.push_back(ColumnBlock<ColBasedChunk>::share(handlers[i]));
+        }
+      }
+    }
+
+    /*
+      Parses the chunks on params.num_threads threads. There are several
+      chunks per thread, each with its own worker and column handlers, so
+      the order of the rows is kept while threads that finish early take
+      chunks from the others.
+     */
+    template <class Dialect>
     void spawn_parse_workers(const std::string &filename, const ParaText::ParseParams &params) {
-      std::vector<std::thread> threads;
-      std::vector<std::shared_ptr<ColBasedParseWorker<ColBasedChunk> > > workers;
+      typedef ColBasedParseWorker<ColBasedChunk, Dialect> worker_type;
+      std::vector<std::shared_ptr<worker_type> > workers;
+      std::vector<std::pair<long long, long long> > chunks;
       //std::cerr << "number of threads: " << num_threads_ << std::endl;
       std::exception_ptr thread_exception;
-      size_t num_threads = chunker_.num_chunks();
       column_chunks_.clear();
-      for (size_t worker_id = 0; worker_id < num_threads; worker_id++) {
+      for (size_t worker_id = 0; worker_id < chunker_.num_chunks(); worker_id++) {
         long long start_of_chunk = 0, end_of_chunk = 0;
         std::tie(start_of_chunk, end_of_chunk) = chunker_.get_chunk(worker_id);
         
@@ -552,40 +1023,31 @@ namespace ParaText {
         if (start_of_chunk < 0 || end_of_chunk < 0) {
           continue;
         }
-        column_chunks_.emplace_back();
-        for (size_t col = 0; col < column_infos_.size(); col++) {
-          auto fit = forced_semantics_.find(column_infos_[col].name);
-          if (fit == forced_semantics_.end()) {
-            column_chunks_.back().push_back(std::make_shared<ColBasedChunk>(column_infos_[col].name, params.max_level_name_length, params.max_levels, Semantics::UNKNOWN));
-          }
-          else {
-            column_chunks_.back().push_back(std::make_shared<ColBasedChunk>(column_infos_[col].name, params.max_level_name_length, params.max_levels, fit->second));
-          }
-        }
+        auto block = create_column_handlers(params, chunker_.estimate_num_records(worker_id));
+        column_chunks_.push_back(ColumnBlock<ColBasedChunk>::share(block));
 #ifdef PARALOAD_DEBUG
-        std::cerr << "number of handlers: " << column_chunks_.back().size()
+        std::cerr << "number of handlers: " << block->size()
                   << " start: " << start_of_chunk
                   << " end: " << end_of_chunk
                   << " length: " << ((end_of_chunk - start_of_chunk) + 1) << std::endl;
 #endif
-        workers.push_back(std::make_shared<ColBasedParseWorker<ColBasedChunk> >(column_chunks_.back()));
-        threads.emplace_back(&ColBasedParseWorker<ColBasedChunk>::parse,
-                             workers.back(),
-                             filename,
-                             start_of_chunk,
-                             end_of_chunk,
-                             header_parser_.get_end_of_header(),
-                             length_,
-                             params);
-      }
-      for (size_t i = 0; i < threads.size(); i++) {
-        threads[i].join();
+        workers.push_back(std::make_shared<worker_type>(block, selected_, row_filter_));
+        if (expected_tokens_.size() > 0) {
+          workers.back()->expect_tokens(expected_tokens_);
+        }
+        chunks.push_back(std::make_pair(start_of_chunk, end_of_chunk));
+      }
+      parallel_for_each_stealing(workers.size(), params.num_threads, [&](size_t i, size_t thread_id) {
+          (void)thread_id;
+          workers[i]->parse(filename, chunks[i].first, chunks[i].second, header_parser_.get_end_of_header(), length_, params);
+        });
+      for (size_t i = 0; i < workers.size(); i++) {
         if (!thread_exception) {
           thread_exception = workers[i]->get_exception();
         }
       }
 #if 0
-      if (threads.size() == 0) {
+      if (workers.size() == 0) {
         column_chunks_.emplace_back();
         for (size_t col = 0; col < column_infos_.size(); col++) {
           auto fit = forced_semantics_.find(column_infos_[col].name);
@@ -611,8 +1073,16 @@ namespace ParaText {
         for (size_t worker_id = 0; worker_id < column_chunks_.size(); worker_id++) {
           const auto &clist = column_chunks_[worker_id][column_index];
           const size_t sz = clist->size();
+          const std::vector<size_t> &missing = clist->get_missing();
+          size_t next_missing = 0;
           for (size_t i = 0; i < sz; i++) {
-            *it = clist->get<T, true>(i);
+            if (next_missing < missing.size() && missing[next_missing] == i) {
+              *it = std::numeric_limits<T>::quiet_NaN(); /* 0 if T is integral. */
+              next_missing++;
+            }
+            else {
+              *it = clist->get<T, true>(i);
+            }
             it++;
           }
         }
@@ -637,15 +1107,7 @@ namespace ParaText {
         ostr << "numeric output iterator expected for column " << column_index << ", not std::string element type.";
         throw std::logic_error(ostr.str());
       } else if (column_infos_[column_index].semantics == Semantics::TEXT) {
-        //std::cout << "^^^" << column_index << std::endl;
-        for (size_t worker_id = 0; worker_id < column_chunks_.size(); worker_id++) {
-          const auto &clist = column_chunks_[worker_id][column_index];
-          const size_t sz = clist->size();
-          for (size_t i = 0; i < sz; i++) {
-            *it = clist->get_text(i);
-            it++;
-          }
-        }
+        copy_text_column(column_index, it);
       }
       else {
         std::ostringstream ostr;
@@ -662,14 +1124,7 @@ namespace ParaText {
         throw std::logic_error(ostr.str());
       }
       else if (column_infos_[column_index].semantics == Semantics::TEXT) {
-        for (size_t worker_id = 0; worker_id < column_chunks_.size(); worker_id++) {
-          const auto &clist = column_chunks_[worker_id][column_index];
-          const size_t sz = clist->size();
-          for (size_t i = 0; i < sz; i++) {
-            *it = std::move(clist->get_text(i));
-            it++;
-          }
-        }
+        copy_text_column(column_index, it);
       }
       else {
         std::ostringstream ostr;
@@ -678,6 +1133,24 @@ namespace ParaText {
       }
     }
 
+    /*
+      Copies the values of a text column, reading the bytes of each chunk
+      in order. Each value is assigned from one string whose buffer is
+      reused, so that an iterator that keeps its own string, like the
+      Python populator's, does not allocate per value.
+     */
+    template <class OutputIterator>
+    void copy_text_column(size_t column_index, OutputIterator &it) const {
+      std::string text;
+      for (size_t worker_id = 0; worker_id < column_chunks_.size(); worker_id++) {
+        column_chunks_[worker_id][column_index]->for_each_text([&](const char *begin, const char *end) {
+            text.assign(begin, end);
+            *it = text;
+            it++;
+          });
+      }
+    }
+
     template <class T>
     typename std::enable_if<std::is_arithmetic<T>::value, void >::type copy_column_into_buffer_impl(size_t column_index, T *buffer) const {
       if (column_infos_[column_index].semantics == Semantics::NUMERIC) {
@@ -698,6 +1171,21 @@ namespace ParaText {
     }
 
   private:
+    /*
+      A comparison passed to filter_rows() or filter_rows_by_text(),
+      before its column is found in the header.
+     */
+    struct FilterComparison {
+      FilterComparison(const std::string &column_name, Comparison comparison, size_t conjunction)
+        : column_name(column_name), comparison(comparison), conjunction(conjunction), numeric(false), number(0.0) {}
+      std::string column_name;
+      Comparison comparison;
+      size_t conjunction;
+      bool numeric;
+      double number;
+      std::string text;
+    };
+
     mutable std::vector<std::unordered_map<std::string, size_t> > level_ids_;
     mutable std::vector<std::vector<std::string> > level_names_;
     std::vector<size_t> size_;
@@ -705,7 +1193,15 @@ namespace ParaText {
     TextChunker chunker_;
     size_t length_;
     std::unordered_map<std::string, Semantics> forced_semantics_;
+    std::unordered_map<std::string, StorageType> forced_types_;
+    std::vector<std::string> selected_names_;
+    std::vector<size_t> selected_indices_;
+    std::vector<bool> selected_;
+    std::vector<FilterComparison> filter_comparisons_;
+    std::shared_ptr<const RowFilter> row_filter_;
+    std::vector<ExpectedToken> expected_tokens_;
     mutable size_t cached_categorical_column_index_;
+    size_t num_parse_rounds_;
     mutable std::vector<std::vector<std::shared_ptr<ColBasedChunk> > > column_chunks_;
     std::vector<ColumnInfo> column_infos_;
     std::vector<int> all_numeric_;
@@ -714,6 +1210,7 @@ namespace ParaText {
     std::vector<std::type_index> common_type_index_;
     Encoding in_encoding_;
     Encoding out_encoding_;
+    FloatPrecision float_precision_;
   };
 
   std::type_index ColBasedPopulator::get_type_index() const {
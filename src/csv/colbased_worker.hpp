@@ -30,20 +30,103 @@
 
 #include "util/strings.hpp"
 #include "util/widening_vector.hpp"
+#include "util/mapped_file.hpp"
+#include "util/async_block_reader.hpp"
+#include "util/direct_file_reader.hpp"
+#include "util/byte_masks.hpp"
+#include "util/token_classifier.hpp"
+#include "generic/quote_adjustment_worker.hpp"
+#include "generic/dialect.hpp"
+#include "generic/row_filter.hpp"
+#include "csv/column_block.hpp"
 
 #include <fstream>
 #include <exception>
 #include <stdexcept>
 #include <locale>
+#include <algorithm>
+#include <vector>
 
 namespace ParaText {
 
 namespace CSV {
 
-template <class ColumnHandler>
+/*
+  Parses the records of a chunk written in the ``Dialect`` and passes
+  each field to the handler of its column.
+ */
+template <class ColumnHandler, class Dialect = CommaDialect>
 class ColBasedParseWorker {
 public:
-  ColBasedParseWorker(std::vector<std::shared_ptr<ColumnHandler> > &handlers) : handlers_(handlers), lines_parsed_(0), quote_started_('\0'), column_index_(0), escape_jump_(0) {}
+  /*
+    Constructs a worker that passes the fields of each record to the
+    handlers in ``block``. If ``selected`` is not empty, it has an entry
+    for each field of a record, and the handlers are assigned in order
+    to the selected fields only. The other fields are skipped without
+    being parsed.
+
+    If ``row_filter`` is set, the fields of a record are set aside until
+    the record ends, and are passed to the handlers only if the filter
+    accepts the record.
+   */
+  ColBasedParseWorker(const std::shared_ptr<ColumnBlock<ColumnHandler> > &block,
+                      const std::vector<bool> &selected = std::vector<bool>(),
+                      const std::shared_ptr<const RowFilter> &row_filter = std::shared_ptr<const RowFilter>())
+    : block_(block),
+      handlers_(block->data()),
+      num_columns_(selected.empty() ? block->size() : selected.size()),
+      lines_parsed_(0),
+      quote_started_('\0'),
+      quote_closed_(false),
+      column_index_(0),
+      escape_jump_(0),
+      spos_line_(0),
+      quote_scanner_(0, 0),
+      quote_state_(QuoteState::OUTSIDE_QUOTES),
+      speculative_(false),
+      started_(true),
+      done_(false),
+      failed_(false),
+      stop_offset_(std::numeric_limits<size_t>::max()),
+      row_filter_(row_filter),
+      filtering_(row_filter && !row_filter->empty()),
+      replaying_(false),
+      rows_to_skip_(0),
+      max_rows_(std::numeric_limits<size_t>::max()),
+      rows_loaded_(0) {
+    const size_t num_selected = selected.empty() ? num_columns_ : std::count(selected.begin(), selected.end(), true);
+    if (num_selected != block->size()) {
+      std::ostringstream ostr;
+      ostr << "expected a handler for each of the " << num_selected << " selected columns, got " << block->size();
+      throw std::logic_error(ostr.str());
+    }
+    field_handlers_.reserve(num_columns_);
+    ColumnHandler *next_handler = handlers_;
+    for (size_t field = 0; field < num_columns_; field++) {
+      field_handlers_.push_back((selected.empty() || selected[field]) ? next_handler++ : NULL);
+    }
+    expected_.resize(num_columns_, ExpectedToken::ANY_EXPECTED);
+    if (filtering_) {
+      const std::vector<size_t> &filter_fields = row_filter_->get_fields();
+      for (size_t i = 0; i < filter_fields.size(); i++) {
+        if (filter_fields[i] >= num_columns_) {
+          std::ostringstream ostr;
+          ostr << "row filter reads field " << filter_fields[i] << ", but records have " << num_columns_ << " fields";
+          throw std::logic_error(ostr.str());
+        }
+      }
+      kept_fields_.resize(num_columns_, 0);
+      for (size_t field = 0; field < num_columns_; field++) {
+        kept_fields_[field] = field_handlers_[field] != NULL;
+      }
+      for (size_t i = 0; i < filter_fields.size(); i++) {
+        kept_fields_[filter_fields[i]] = 1;
+      }
+      row_spans_.resize(num_columns_);
+      row_quoted_.resize(num_columns_, 0);
+      filter_text_.resize(filter_fields.size());
+    }
+  }
 
   virtual ~ColBasedParseWorker() {}
 
@@ -53,6 +136,10 @@ public:
              size_t data_begin,
              size_t file_end,
              const ParaText::ParseParams &params) {
+    speculative_ = false;
+    started_ = true;
+    done_ = rows_to_skip_ == 0 && max_rows_ == 0;
+    stop_offset_ = std::numeric_limits<size_t>::max();
     try {
       if (params.number_only) {
         parse_impl<true>(filename, begin, end, data_begin, file_end, params);
@@ -66,10 +153,111 @@ public:
     }
   }
 
+  /*
+    Parses the records that begin in a chunk whose boundaries were not
+    aligned to records, without a separate pass to resolve quoted newlines.
+
+    Unless ``record_start`` is set, the worker skips to the first newline
+    that ends a record under the assumed quote state at ``begin``; if the
+    state is unknown, it is guessed. The last record is followed past
+    ``end`` to its newline. Meanwhile the unescaped quotes in [begin, end]
+    are counted so the caller can check the assumption against the quote
+    parity of the preceding chunks and, if it was wrong, parse the chunk
+    again with a fresh set of handlers.
+
+    Errors raised while tokenizing are kept in get_parse_exception(), since
+    they may be an artifact of a wrong assumption.
+   */
+  void parse_speculative(const std::string &filename,
+                         size_t begin,
+                         size_t end,
+                         size_t file_end,
+                         bool record_start,
+                         QuoteState quote_state,
+                         const ParaText::ParseParams &params) {
+    speculative_ = true;
+    started_ = record_start;
+    done_ = false;
+    failed_ = false;
+    stop_offset_ = end + 1;
+    quote_state_ = record_start ? QuoteState::OUTSIDE_QUOTES : quote_state;
+    quote_scanner_ = QuoteNewlineAdjustmentWorker<Dialect>(begin, end);
+    try {
+      if (params.number_only) {
+        parse_impl<true>(filename, begin, end, 0, file_end, params);
+      }
+      else {
+        parse_impl<false>(filename, begin, end, 0, file_end, params);
+      }
+    }
+    catch (...) {
+      thread_exception_ = std::current_exception();
+    }
+  }
+
   std::exception_ptr get_exception() {
     return thread_exception_;
   }
 
+  /*
+    Returns the first tokenizing error of a speculative parse.
+   */
+  std::exception_ptr get_parse_exception() {
+    return parse_exception_;
+  }
+
+  /*
+    Returns the quote state a speculative parse assumed at the start of
+    its chunk.
+   */
+  QuoteState get_quote_state() const {
+    return quote_state_;
+  }
+
+  /*
+    Returns the number of unescaped quotes in the chunk of a speculative parse.
+   */
+  size_t get_num_quotes() const {
+    return quote_scanner_.get_num_quotes();
+  }
+
+  /*
+    Returns the number of records parsed.
+   */
+  size_t get_num_lines_parsed() const {
+    return lines_parsed_;
+  }
+
+  /*
+    Called before parse(). Skips the first ``rows_to_skip`` records of
+    the chunk without parsing their fields, and stops reading once
+    ``max_rows`` records have been passed to the handlers.
+   */
+  void limit_rows(size_t rows_to_skip, size_t max_rows) {
+    rows_to_skip_ = rows_to_skip;
+    max_rows_ = max_rows;
+  }
+
+  /*
+    Called before parse(). Sets the kind of token expected in each field
+    of a record, so that tokens of that kind skip full classification.
+   */
+  void expect_tokens(const std::vector<ExpectedToken> &expected) {
+    if (expected.size() != num_columns_) {
+      std::ostringstream ostr;
+      ostr << "expected a token kind for each of the " << num_columns_ << " fields, got " << expected.size();
+      throw std::logic_error(ostr.str());
+    }
+    expected_ = expected;
+  }
+
+  /*
+    Returns the file offset of the first record not yet parsed.
+   */
+  size_t get_next_record_offset() const {
+    return spos_line_;
+  }
+
   template <bool NumberOnly>
   void parse_impl(const std::string &filename,
                   size_t begin,
@@ -78,276 +266,650 @@ public:
                   size_t file_end,
                   const ParaText::ParseParams &params) {
     (void)data_begin;
-    (void)file_end;
-    std::ifstream in;
-    in.open(filename.c_str(), std::ios::binary);
     column_index_ = 0;
     quote_started_ = '\0';
+    quote_closed_ = false;
     escape_jump_ = 0;
-    size_t current = begin;
-    size_t spos_line = begin, epos_line = begin;
-    const size_t block_size = params.block_size;
+    spos_line_ = begin;
     convert_null_to_space_ = params.convert_null_to_space;
+    definitely_string_ = false;
+    if (params.io_method == IOMethod::MEMORY_MAPPED) {
+      MappedFileRegion region(filename, begin, end);
+      consume_block<NumberOnly>(region.data(), region.size(), begin);
+    }
+    else if (params.io_method == IOMethod::ASYNC_READ) {
+      AsyncBlockReader reader(filename, begin, end, params.block_size, params.num_read_ahead_blocks);
+      size_t current = begin;
+      const char *buf = NULL;
+      size_t nread = 0;
+      while (!done_reading() && (nread = reader.next(buf)) > 0) {
+        consume_block<NumberOnly>(buf, nread, current);
+        current += nread;
+      }
+    }
+    else if (params.io_method == IOMethod::DIRECT_READ) {
+      DirectFileReader reader(filename);
+      const size_t block_size = DirectFileReader::round_up(params.block_size);
+      size_t current = begin;
+      while (!done_reading() && current <= end) {
+        /* Only the first and last reads of the chunk are unaligned. */
+        const char *buf = NULL;
+        size_t nread = reader.read(current, std::min(end - current + 1, block_size - current % block_size), buf);
+        if (nread == 0) {
+          break;
+        }
+        consume_block<NumberOnly>(buf, nread, current);
+        current += nread;
+      }
+    }
+    else {
+      std::ifstream in;
+      in.open(filename.c_str(), std::ios::binary);
+      size_t current = begin;
+      const size_t block_size = params.block_size;
 #ifndef _WIN32
-    char buf[block_size];
+      char buf[block_size];
 #else
-    char *buf = (char *)_malloca(block_size);
+      char *buf = (char *)_malloca(block_size);
 #endif
-    in.seekg(current, std::ios_base::beg);
-    definitely_string_ = false;
+      in.seekg(current, std::ios_base::beg);
 #ifdef PARALOAD_DEBUG
-    size_t round = 0;
+      size_t round = 0;
 #endif
-    while (current <= end) {
-      if (current % block_size == 0) { /* The block is aligned. */
-        in.read(buf, std::min(end - current + 1, block_size));
-      }
-      else { /* Our first read should ensure our further reads are block-aligned. */
-        in.read(buf, std::min(end - current + 1, std::min(block_size, current % block_size)));
-      }
-      size_t nread = in.gcount();
+      while (!done_reading() && current <= end) {
+        if (current % block_size == 0) { /* The block is aligned. */
+          in.read(buf, std::min(end - current + 1, block_size));
+        }
+        else { /* Our first read should ensure our further reads are block-aligned. */
+          in.read(buf, std::min(end - current + 1, std::min(block_size, current % block_size)));
+        }
+        size_t nread = in.gcount();
 #ifdef PARALOAD_DEBUG
-      if (round == 0) {
-        std::cout << "R{" << std::string((char *)buf, (char *)buf + nread) << std::endl;
+        if (round == 0) {
+          std::cout << "R{" << std::string((char *)buf, (char *)buf + nread) << std::endl;
+        }
+        round++;
+#endif
+        if (nread == 0) {
+          break;
+        }
+        consume_block<NumberOnly>(buf, nread, current);
+        current += nread;
       }
-      round++;
+    }
+    if (speculative_ && started_ && !done_ && !failed_ && end + 1 < file_end) {
+      parse_past_end<NumberOnly>(filename, end + 1, file_end, params);
+    }
+    if (started_ && !done_ && !failed_) {
+      run_guarded([this, end]() {
+          /*
+            If we're in the last column position, process the token as some files
+            do not end with a newline.
+          */
+          if (token_.size() > 0) {
+            if (NumberOnly) {
+              process_token_number_only();
+            } else {
+              process_token();
+            }
+          }
+          /*
+            If there was data on the last line, process it.
+          */
+          if (column_index_ > 0) {
+            process_newline<NumberOnly>();
+          }
+          /* The chunk is exhausted. */
+          spos_line_ = end + 1;
+        });
+    }
+    run_guarded([this]() {
+        /* Pass on the numbers the handlers still hold back. */
+        for (size_t i = 0; i < field_handlers_.size(); i++) {
+          if (field_handlers_[i] != NULL) {
+            field_handlers_[i]->flush();
+          }
+        }
+      });
+#ifdef PARALOAD_DEBUG
+    std::cout << "lines parsed: " << lines_parsed_ << std::endl;
 #endif
+    return;
+  }
+
+  /*
+    Passes a block read from the chunk to the tokenizer. In a speculative
+    parse, the block is also scanned for quotes, and nothing is tokenized
+    until the first record boundary has been found.
+   */
+  template <bool NumberOnly>
+  void consume_block(const char *buf, size_t nread, size_t current) {
+    if (speculative_) {
+      quote_scanner_.scan_block(buf, nread, current);
+      if (!started_) {
+        if (quote_state_ == QuoteState::UNKNOWN_QUOTE_STATE) {
+          quote_state_ = guess_quote_state(buf, nread);
+        }
+        const long long pos = quote_state_ == QuoteState::INSIDE_QUOTES
+          ? quote_scanner_.get_first_quoted_newline()
+          : quote_scanner_.get_first_unquoted_newline();
+        if (pos < 0) {
+          return;
+        }
+        const size_t skip = pos + 1 - current;
+        started_ = true;
+        spos_line_ = pos + 1;
+        buf += skip;
+        nread -= skip;
+        current += skip;
+      }
+    }
+    if (started_ && !done_ && !failed_) {
+      run_guarded([&]() { this->parse_block<NumberOnly>(buf, nread, current); });
+    }
+  }
+
+  /*
+    Whether the rest of the chunk can be left unread. A speculative parse
+    reads its chunk to the end to count its quotes, even once it has
+    stopped tokenizing.
+   */
+  bool done_reading() const {
+    return done_ && !speculative_;
+  }
+
+  /*
+    Follows the last record of a speculative parse past the end of the
+    chunk until the newline that ends it.
+   */
+  template <bool NumberOnly>
+  void parse_past_end(const std::string &filename, size_t begin, size_t file_end, const ParaText::ParseParams &params) {
+    std::ifstream in;
+    std::unique_ptr<DirectFileReader> direct_in;
+    std::vector<char> block(params.block_size);
+    if (params.io_method == IOMethod::DIRECT_READ) {
+      direct_in.reset(new DirectFileReader(filename));
+    }
+    else {
+      in.open(filename.c_str(), std::ios::binary);
+      in.seekg(begin, std::ios_base::beg);
+    }
+    size_t current = begin;
+    while (!done_ && !failed_ && current < file_end) {
+      const char *buf = block.data();
+      size_t nread = 0;
+      if (direct_in) {
+        nread = direct_in->read(current, block.size(), buf);
+      }
+      else {
+        in.read(block.data(), block.size());
+        nread = in.gcount();
+      }
       if (nread == 0) {
         break;
       }
-      if (NumberOnly) {
-        size_t i = 0;
-        for (; i < nread; i++) {
-          if (buf[i] == ',') {
-            process_token_number_only();
+      run_guarded([&]() { this->parse_block<NumberOnly>(buf, nread, current); });
+      current += nread;
+    }
+  }
+
+  /*
+    Guesses whether a chunk begins inside a quoted field from the first
+    unescaped quote near its start: a quote followed by a delimiter or a
+    line ending more likely closes a field than opens one.
+   */
+  static QuoteState guess_quote_state(const char *buf, size_t nread) {
+    const size_t window = std::min(nread, (size_t)4096);
+    for (size_t i = 0; i < window; i++) {
+      if (Dialect::backslash_escapes && buf[i] == '\\') {
+        i++;
+      }
+      else if (buf[i] == Dialect::quote) {
+        if (i + 1 < window && (buf[i + 1] == Dialect::delimiter || buf[i + 1] == '\n' || buf[i + 1] == '\r')) {
+          return QuoteState::INSIDE_QUOTES;
+        }
+        return QuoteState::OUTSIDE_QUOTES;
+      }
+    }
+    return QuoteState::OUTSIDE_QUOTES;
+  }
+
+  /*
+    Runs a tokenizer step. A speculative parse records the first error and
+    stops tokenizing rather than throwing, so that it keeps counting quotes.
+   */
+  template <class F>
+  void run_guarded(F f) {
+    if (!speculative_) {
+      f();
+      return;
+    }
+    try {
+      f();
+    }
+    catch (...) {
+      parse_exception_ = std::current_exception();
+      failed_ = true;
+    }
+  }
+
+  /*
+    Tokenizes a block of bytes. The block starts at file offset ``current``
+    and the tokenizer state carries over from the previous block.
+
+    Structural characters are located 64 bytes at a time with a bitmask.
+    The bytes between two structural characters are never inspected
+    individually: an unquoted, unescaped field is handed to the token
+    processor as a span of the block, and anything else is appended to
+    the token buffer in one piece.
+   */
+  template <bool NumberOnly>
+  void parse_block(const char *buf, size_t nread, size_t current) {
+    size_t window_start = nread;
+    uint64_t window_mask = 0;
+    for (size_t i = 0; i < nread;) {
+      if (Dialect::backslash_escapes && escape_jump_ > 0) {
+        escape_jump_--;
+        if (quote_started_ == '\0') {
+          if (buf[i] == 'x') {
+            escape_jump_ += 2;
           }
-          else if (buf[i] == '\r') { /* do nothing. */}
-          else if (buf[i] == '\n') {
-            epos_line = current + i;
-            if (epos_line - spos_line > 0) {
-              process_token_number_only();
-              process_newline();
-            }
-            spos_line = epos_line + 1;
-            epos_line = spos_line;
-          } else {
-            token_.push_back(buf[i]);
+          else if (buf[i] == 'u') {
+            escape_jump_ += 4;
           }
         }
-      } else {
-        for (size_t i = 0; i < nread;) {
-          if (quote_started_ != '\0') {
-            for (; i < nread; i++) {
-              if (escape_jump_ > 0) {
-                escape_jump_--;
-              }
-              else if (buf[i] == '\\') {
-                escape_jump_ = 1;
-              }
-              else if (buf[i] == quote_started_) {
-                i++;
-                quote_started_ = '\0';
-                break;
-              }
-              token_.push_back(buf[i]);
-            }
-          }
-          else {
-            for (; i < nread; i++) {
-              if (escape_jump_ > 0) {
-                escape_jump_--;
-                if (buf[i] == 'x') {
-                  escape_jump_ += 2;
-                }
-                else if (buf[i] == 'u') {
-                  escape_jump_ += 4;
-                }
-                token_.push_back(buf[i]);
-              }
-              else if (buf[i] == '\\') {
-                escape_jump_ = 1;
-                token_.push_back(buf[i]);
-              }
-              else if (buf[i] == '"') {
-                i++;
-                quote_started_ = '\"';
-                definitely_string_ = true;
-                break;
-              }
-              else if (buf[i] == ',') {
-                process_token();
-              }
-              else if (buf[i] == '\r') { /* do nothing: dos wastes a byte each line. */ }
-              else if (buf[i] == '\n') {
-                epos_line = current + i;
-                if (epos_line - spos_line > 0) {
-                  process_token();
-                  process_newline();
-                }
-                spos_line = epos_line + 1;
-                epos_line = spos_line;
-              }
-              else {
-                token_.push_back(buf[i]);
-              }
-            }
+        token_.push_back(buf[i]);
+        i++;
+        continue;
+      }
+      /* Find the next structural character at or after i. */
+      size_t j = i;
+      while (j < nread) {
+        const size_t start = j - j % ByteBlock64::size;
+        if (start != window_start) {
+          window_start = start;
+          window_mask = get_structural_mask<NumberOnly>(buf + start, std::min((size_t)ByteBlock64::size, nread - start));
+        }
+        const uint64_t mask = window_mask & ~low_bits_mask(j - start);
+        if (mask != 0) {
+          j = start + lowest_bit_index(mask);
+          break;
+        }
+        j = start + ByteBlock64::size;
+      }
+      if (j >= nread) {
+        token_.insert(token_.end(), buf + i, buf + nread);
+        quote_closed_ = false;
+        break;
+      }
+      const char c = buf[j];
+      /* A quote right after a closing quote is a doubled quote. */
+      const bool after_closing_quote = quote_closed_ && j == i;
+      quote_closed_ = false;
+      if (quote_started_ != '\0') {
+        if (c == quote_started_) {
+          token_.insert(token_.end(), buf + i, buf + j);
+          quote_started_ = '\0';
+          quote_closed_ = Dialect::doubled_quotes;
+        }
+        else {
+          if (Dialect::backslash_escapes && c == '\\') {
+            escape_jump_ = 1;
           }
+          token_.insert(token_.end(), buf + i, buf + j + 1);
         }
       }
-      current += nread;
+      else if (c == Dialect::delimiter) {
+        process_token_span<NumberOnly>(buf + i, buf + j);
+      }
+      else if (c == '\n') {
+        const size_t epos_line = current + j;
+        if (epos_line - spos_line_ > 0) {
+          process_token_span<NumberOnly>(buf + i, buf + j);
+          process_newline<NumberOnly>();
+        }
+        spos_line_ = epos_line + 1;
+        if (done_ || epos_line >= stop_offset_) { /* the row limit was reached, or the last record of a speculative parse ended. */
+          done_ = true;
+          return;
+        }
+      }
+      else if (c == '\r') { /* do nothing: dos wastes a byte each line. */
+        token_.insert(token_.end(), buf + i, buf + j);
+      }
+      else if (Dialect::backslash_escapes && c == '\\') {
+        escape_jump_ = 1;
+        token_.insert(token_.end(), buf + i, buf + j + 1);
+      }
+      else { /* c == Dialect::quote */
+        token_.insert(token_.end(), buf + i, buf + j);
+        if (after_closing_quote) {
+          token_.push_back(c);
+        }
+        quote_started_ = c;
+        definitely_string_ = true;
+      }
+      i = j + 1;
     }
-    epos_line = end + 1;
-    //std::cout << "start line: " << spos_linen << " end line: " << epos_line << std::endl;
-    /*
-      If we're in the last column position, process the token as some files
-      do not end with a newline.
-     */
-    if (token_.size() > 0) {
-      if (NumberOnly) {
-        process_token_number_only();
-      } else {
-        process_token();
+  }
+
+  /*
+    Returns the mask of structural characters among the first ``n`` bytes
+    at ``p``. Only delimiters and line endings matter when the file is
+    known to contain numbers only.
+   */
+  template <bool NumberOnly>
+  static uint64_t get_structural_mask(const char *p, size_t n) {
+    char tail[ByteBlock64::size] = {0};
+    if (n < ByteBlock64::size) {
+      std::copy(p, p + n, tail);
+      p = tail;
+    }
+    ByteBlock64 block(p);
+    uint64_t mask = block.eq(Dialect::delimiter) | block.eq('\n') | block.eq('\r');
+    if (!NumberOnly) {
+      mask |= block.eq(Dialect::quote);
+      if (Dialect::backslash_escapes) {
+        mask |= block.eq('\\');
       }
     }
-    /*
-      If there was data on the last line, process it.
-    */
-    if (column_index_ > 0) {
-      process_newline();
+    return mask;
+  }
+
+  /*
+    Processes the token that ends at a delimiter. If no part of the token
+    was buffered, the span [begin, end) of the block is processed in place.
+   */
+  template <bool NumberOnly>
+  void process_token_span(const char *begin, const char *end) {
+    if (token_.size() > 0) {
+      token_.insert(token_.end(), begin, end);
+      begin = token_.data();
+      end = token_.data() + token_.size();
     }
-#ifdef PARALOAD_DEBUG
-    std::cout << "lines parsed: " << lines_parsed_ << std::endl;
-#endif
-    return;
+    if (NumberOnly) {
+      process_token_number_only(begin, end);
+    }
+    else {
+      process_token(begin, end);
+    }
+    token_.clear();
   }
 
+  template <bool NumberOnly>
   void process_newline() {
-    if (column_index_ != handlers_.size()) {
+    if (column_index_ != num_columns_) {
       std::ostringstream ostr;
-      ostr << "improper number of columns on line number (unquoted in chunk): " << (lines_parsed_ + 1) << ". Expected: " << handlers_.size();
+      ostr << "improper number of columns on line number (unquoted in chunk): " << (lines_parsed_ + 1) << ". Expected: " << num_columns_;
       throw std::logic_error(ostr.str());
     }
+    if (rows_to_skip_ > 0) {
+      rows_to_skip_--;
+    }
+    else if (filtering_) {
+      if (accept_row()) {
+        commit_row<NumberOnly>();
+        rows_loaded_++;
+      }
+      row_text_.clear();
+    }
+    else {
+      rows_loaded_++;
+    }
     column_index_ = 0;
     lines_parsed_++;
+    done_ = done_ || (rows_to_skip_ == 0 && rows_loaded_ >= max_rows_);
   }
 
-  void process_token_number_only() {
-    if (column_index_ >= handlers_.size()) {
-      std::ostringstream ostr;
-      ostr << "too many columns on line number (unquoted in chunk): " << (lines_parsed_ + 1) << ". Expected: " << handlers_.size();
-      throw std::logic_error(ostr.str());
+  /*
+    Sets aside the text of the current field until the record ends, if
+    the field is loaded or read by the row filter.
+   */
+  void set_aside_token(const char *begin, const char *end) {
+    if (kept_fields_[column_index_]) {
+      row_spans_[column_index_] = std::make_pair(row_text_.size(), row_text_.size() + (end - begin));
+      row_text_.insert(row_text_.end(), begin, end);
+      row_quoted_[column_index_] = definitely_string_;
     }
-    size_t i = 0;
-    for (; i < token_.size() && isspace(token_[i]); i++) {}
-    if (i < token_.size()) {
-      if (token_[i] == '?' && token_.size() - i == 1) {
-        handlers_[column_index_]->process_float(std::numeric_limits<float>::quiet_NaN());
-      }
-      else if (token_.size() - i == 3 &&
-               ((token_[i] == 'n' || token_[i] == 'N'))
-               && ((token_[i+1] == 'a' || token_[i+1] == 'A'))
-               && (token_[i+2] == 'n' || token_[i+2] == 'N')) {
-        handlers_[column_index_]->process_float(std::numeric_limits<float>::quiet_NaN());
-      }
-      else {
-        if (token_[i] == '-') { i++; }
-        for (; i < token_.size() && isdigit(token_[i]); i++) {}
-        if (i < token_.size() && (token_[i] == '.' || token_[i] == 'E' || token_[i] == 'e')) {
-          handlers_[column_index_]->process_float(bsd_strtod(token_.begin(), token_.end()));
+    definitely_string_ = false;
+    column_index_++;
+  }
+
+  /*
+    Evaluates the row filter on the fields set aside for the record.
+   */
+  bool accept_row() {
+    const std::vector<size_t> &filter_fields = row_filter_->get_fields();
+    filter_offsets_.clear();
+    for (size_t i = 0; i < filter_fields.size(); i++) {
+      const std::pair<size_t, size_t> &span = row_spans_[filter_fields[i]];
+      filter_offsets_.push_back(token_aux_.size());
+      append_string(row_text_.data() + span.first, row_text_.data() + span.second);
+    }
+    filter_offsets_.push_back(token_aux_.size());
+    for (size_t i = 0; i < filter_fields.size(); i++) {
+      filter_text_[i] = std::make_pair(token_aux_.data() + filter_offsets_[i], token_aux_.data() + filter_offsets_[i + 1]);
+    }
+    const bool accepted = row_filter_->accepts(filter_text_);
+    token_aux_.clear();
+    return accepted;
+  }
+
+  /*
+    Passes the fields set aside for an accepted record to their handlers.
+   */
+  template <bool NumberOnly>
+  void commit_row() {
+    replaying_ = true;
+    for (size_t field = 0; field < num_columns_; field++) {
+      if (field_handlers_[field] != NULL) {
+        const char *begin = row_text_.data() + row_spans_[field].first;
+        const char *end = row_text_.data() + row_spans_[field].second;
+        column_index_ = field;
+        definitely_string_ = row_quoted_[field];
+        if (NumberOnly) {
+          process_token_number_only(begin, end);
         }
         else {
-          handlers_[column_index_]->process_integer(fast_atoi<long long>(token_.begin(), token_.end()));
+          process_token(begin, end);
         }
       }
-    } else {
-      handlers_[column_index_]->process_integer(0);
     }
-    column_index_++;
+    replaying_ = false;
+  }
+
+  void process_token_number_only() {
+    process_token_number_only(token_.data(), token_.data() + token_.size());
     token_.clear();
   }
 
+  void process_token_number_only(const char *begin, const char *end) {
+    if (column_index_ >= num_columns_) {
+      std::ostringstream ostr;
+      ostr << "too many columns on line number (unquoted in chunk): " << (lines_parsed_ + 1) << ". Expected: " << num_columns_;
+      throw std::logic_error(ostr.str());
+    }
+    if (rows_to_skip_ > 0) { /* a skipped record. */
+      definitely_string_ = false;
+      column_index_++;
+      return;
+    }
+    if (filtering_ && !replaying_) {
+      set_aside_token(begin, end);
+      return;
+    }
+    if (field_handlers_[column_index_] == NULL) { /* not a selected column. */
+      definitely_string_ = false;
+      column_index_++;
+      return;
+    }
+    long long integer_value = 0;
+    unsigned long long unsigned_value = 0;
+    double float_value = 0.0;
+    switch (TokenClassifier::classify_expected(expected_[column_index_], begin, end, integer_value, unsigned_value, float_value)) {
+    case TokenKind::SIGNED_INTEGER_TOKEN:
+      field_handlers_[column_index_]->process_integer(integer_value);
+      break;
+    case TokenKind::UNSIGNED_INTEGER_TOKEN:
+      field_handlers_[column_index_]->process_unsigned_integer(unsigned_value);
+      break;
+    case TokenKind::INTEGER_OVERFLOW_TOKEN:
+      field_handlers_[column_index_]->process_float(parse_double(begin, end));
+      break;
+    case TokenKind::FLOAT_TOKEN:
+      field_handlers_[column_index_]->process_float(float_value);
+      break;
+    case TokenKind::NAN_TOKEN:
+      field_handlers_[column_index_]->process_float(std::numeric_limits<float>::quiet_NaN());
+      break;
+    default:
+      process_malformed_number(begin, end);
+      break;
+    }
+    column_index_++;
+  }
+
+  /*
+    Reads as much of a number as possible from a token that is not one,
+    for columns known to hold only numbers. A blank token is 0.
+   */
+  void process_malformed_number(const char *begin, const char *end) {
+    const char *p = begin;
+    for (; p != end && is_ascii_space(*p); p++) {}
+    if (p == end) {
+      field_handlers_[column_index_]->process_integer(0);
+      return;
+    }
+    if (*p == '-') { p++; }
+    for (; p != end && isdigit(*p); p++) {}
+    if (p != end && (*p == '.' || *p == 'E' || *p == 'e')) {
+      field_handlers_[column_index_]->process_float(parse_double(begin, end));
+    }
+    else {
+      process_integer_token(begin, end, true);
+    }
+  }
+
   void process_token() {
-    if (column_index_ >= handlers_.size()) {
+    process_token(token_.data(), token_.data() + token_.size());
+    token_.clear();
+  }
+
+  void process_token(const char *begin, const char *end) {
+    if (column_index_ >= num_columns_) {
       std::ostringstream ostr;
-      ostr << "too many columns on line number (unquoted in chunk): " << (lines_parsed_ + 1) << ". Expected: " << handlers_.size();
+      ostr << "too many columns on line number (unquoted in chunk): " << (lines_parsed_ + 1) << ". Expected: " << num_columns_;
       throw std::logic_error(ostr.str());
     }
+    if (rows_to_skip_ > 0) { /* a skipped record. */
+      definitely_string_ = false;
+      column_index_++;
+      return;
+    }
+    if (filtering_ && !replaying_) {
+      set_aside_token(begin, end);
+      return;
+    }
+    if (field_handlers_[column_index_] == NULL) { /* not a selected column. */
+      definitely_string_ = false;
+      column_index_++;
+      return;
+    }
     if (definitely_string_) {
-      parse_unquoted_string(token_.begin(), token_.end(), std::back_inserter(token_aux_));
+      append_string(begin, end);
       if (convert_null_to_space_) {
         convert_null_to_space(token_aux_.begin(), token_aux_.end());
       }
-      handlers_[column_index_]->process_categorical(token_aux_.begin(), token_aux_.end());
+      field_handlers_[column_index_]->process_categorical(token_aux_.begin(), token_aux_.end());
       token_aux_.clear();
       definitely_string_ = false;
     }
     else {
-      size_t i = 0;
-      bool integer_possible = false, float_possible = false, exp_possible = false, handled = false;
-      for (; i < token_.size() && isspace(token_[i]); i++) {}
-      if (i < token_.size()) {
-        if (token_[i] == '-') {
-          i++;
-        }
-        else if (token_[i] == '?' && token_.size() - i == 1) {
-          handlers_[column_index_]->process_float(std::numeric_limits<float>::quiet_NaN());
-          handled = true;
-        }
-        else if ((token_[i] == 'n' || token_[i] == 'N') && token_.size() - i == 3) {
-          if ((token_[i+1] == 'a' || token_[i+1] == 'A') && (token_[i+2] == 'n' || token_[i+2] == 'N')) {
-            handlers_[column_index_]->process_float(std::numeric_limits<float>::quiet_NaN());
-            handled = true;
-          }
-        }
-      }
-      if (!handled && i < token_.size()) {
-        for (; i < token_.size() && isdigit(token_[i]); i++) {}
-        integer_possible = i == token_.size();
-        if (i + 1 < token_.size()) {
-          if (token_[i] == '.') {
-            i++;
-            for (; i < token_.size() && isdigit(token_[i]); i++) {}
-            float_possible = i == token_.size();
-          }
-          if (i + 1 < token_.size() && (i > 0) && (token_[i] == 'E' || token_[i] == 'e')) {
-            i++;
-            if ((i < token_.size() - 1) && (token_[i] == '+' || token_[i] == '-')) {
-              i++;
-            }
-            for (; i < token_.size() && isdigit(token_[i]); i++) {}
-            exp_possible = i == token_.size();
-          }
-        }
-        //}
-      if (integer_possible) {
-        handlers_[column_index_]->process_integer(fast_atoi<long long>(token_.begin(), token_.end()));
-      }
-      else if (float_possible || exp_possible) {
-        handlers_[column_index_]->process_float(bsd_strtod(token_.begin(), token_.end()));
-      }
-      else {
-        parse_unquoted_string(token_.begin(), token_.end(), std::back_inserter(token_aux_));
+      long long integer_value = 0;
+      unsigned long long unsigned_value = 0;
+      double float_value = 0.0;
+      switch (TokenClassifier::classify_expected(expected_[column_index_], begin, end, integer_value, unsigned_value, float_value)) {
+      case TokenKind::SIGNED_INTEGER_TOKEN:
+        field_handlers_[column_index_]->process_integer(integer_value);
+        break;
+      case TokenKind::UNSIGNED_INTEGER_TOKEN:
+        field_handlers_[column_index_]->process_unsigned_integer(unsigned_value);
+        break;
+      case TokenKind::INTEGER_OVERFLOW_TOKEN:
+        field_handlers_[column_index_]->process_categorical(begin, end);
+        break;
+      case TokenKind::FLOAT_TOKEN:
+        field_handlers_[column_index_]->process_float(float_value);
+        break;
+      case TokenKind::NAN_TOKEN:
+        field_handlers_[column_index_]->process_float(std::numeric_limits<float>::quiet_NaN());
+        break;
+      default:
+        append_string(begin, end);
         if (convert_null_to_space_) {
           convert_null_to_space(token_aux_.begin(), token_aux_.end());
         }
-        handlers_[column_index_]->process_categorical(token_aux_.begin(), token_aux_.end());
+        field_handlers_[column_index_]->process_categorical(token_aux_.begin(), token_aux_.end());
         token_aux_.clear();
-      }}
+        break;
+      }
     }
     column_index_++;
-    token_.clear();
+  }
+
+  /*
+    Appends the text of a string token to token_aux_, decoding backslash
+    escapes if the dialect has them.
+   */
+  void append_string(const char *begin, const char *end) {
+    if (Dialect::backslash_escapes) {
+      parse_unquoted_string(begin, end, std::back_inserter(token_aux_));
+    }
+    else {
+      token_aux_.insert(token_aux_.end(), begin, end);
+    }
+  }
+
+  /*
+    Passes an integer token to the handler of the current column. An
+    integer too large for an unsigned long long is kept as its digits,
+    or approximated by a double if the columns are all numbers.
+   */
+  void process_integer_token(const char *begin, const char *end, bool number_only) {
+    long long value = 0;
+    unsigned long long unsigned_value = 0;
+    switch (parse_integer(begin, end, value, unsigned_value)) {
+    case IntegerKind::SIGNED_INTEGER:
+      field_handlers_[column_index_]->process_integer(value);
+      break;
+    case IntegerKind::UNSIGNED_INTEGER:
+      field_handlers_[column_index_]->process_unsigned_integer(unsigned_value);
+      break;
+    default:
+      if (number_only) {
+        field_handlers_[column_index_]->process_float(parse_double(begin, end));
+      }
+      else {
+        field_handlers_[column_index_]->process_categorical(begin, end);
+      }
+      break;
+    }
   }
 
   void convert_to_cat_or_text(size_t column_index) {
-    handlers_[column_index]->convert_to_cat_or_text();
+    handlers_[column_index].convert_to_cat_or_text();
   }
 
   void convert_to_text(size_t column_index) {
-    handlers_[column_index]->convert_to_text();
+    handlers_[column_index].convert_to_text();
   }
 
 private:
-  std::vector<std::shared_ptr<ColumnHandler> > handlers_;
+  std::shared_ptr<ColumnBlock<ColumnHandler> > block_;
+  ColumnHandler *handlers_;
+  std::vector<ColumnHandler *> field_handlers_;
+  std::vector<ExpectedToken> expected_;
+  size_t num_columns_;
   std::vector<char>                            token_;
   std::vector<char>                            token_aux_;
   std::vector<std::pair<size_t, long long> >   long_cache_;
@@ -358,10 +920,32 @@ private:
   bool                                         definitely_string_;
   size_t                                       lines_parsed_;
   char                                         quote_started_;
+  bool                                         quote_closed_;
   size_t                                       column_index_;
   size_t                                       escape_jump_;
+  size_t                                       spos_line_;
   bool                                         convert_null_to_space_;
+  QuoteNewlineAdjustmentWorker<Dialect>        quote_scanner_;
+  QuoteState                                   quote_state_;
+  bool                                         speculative_;
+  bool                                         started_;
+  bool                                         done_;
+  bool                                         failed_;
+  size_t                                       stop_offset_;
+  std::exception_ptr                           parse_exception_;
   std::exception_ptr                           thread_exception_;
+  std::shared_ptr<const RowFilter>             row_filter_;
+  bool                                         filtering_;
+  bool                                         replaying_;
+  std::vector<char>                            kept_fields_;
+  std::vector<char>                            row_text_;
+  std::vector<std::pair<size_t, size_t> >      row_spans_;
+  std::vector<char>                            row_quoted_;
+  std::vector<size_t>                          filter_offsets_;
+  std::vector<std::pair<const char *, const char *> > filter_text_;
+  size_t                                       rows_to_skip_;
+  size_t                                       max_rows_;
+  size_t                                       rows_loaded_;
 };
 }
 }
@@ -0,0 +1,126 @@
+/*
+    ParaText: parallel text reading
+    Copyright (C) 2016. wise.io, Inc.
+
+   Licensed to the Apache Software Foundation (ASF) under one
+   or more contributor license agreements.  See the NOTICE file
+   distributed with this work for additional information
+   regarding copyright ownership.  The ASF licenses this file
+   to you under the Apache License, Version 2.0 (the
+   "License"); you may not use this file except in compliance
+   with the License.  You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing,
+   software distributed under the License is distributed on an
+   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+   KIND, either express or implied.  See the License for the
+   specific language governing permissions and limitations
+   under the License.
+ */
+
+#ifndef PARATEXT_COLUMN_BLOCK_HPP
+#define PARATEXT_COLUMN_BLOCK_HPP
+
+#include <memory>
+#include <vector>
+#include <new>
+#include <utility>
+#include <stdexcept>
+#include <cstddef>
+
+namespace ParaText {
+
+namespace CSV {
+
+  /*
+    The column handlers of one chunk, stored next to each other in a
+    single allocation. A parse worker indexes the handlers directly by
+    column rather than following a separately allocated object per
+    column, which matters for files with many thousands of columns.
+
+    The handlers are constructed in place and never moved, so handler
+    types that hold pointers into themselves are allowed.
+   */
+  template <class ColumnHandler>
+  class ColumnBlock {
+  public:
+    /*
+      Allocates the storage for ``capacity`` handlers without
+      constructing any of them.
+     */
+    explicit ColumnBlock(size_t capacity)
+      : handlers_((ColumnHandler *)::operator new(sizeof(ColumnHandler) * (capacity > 0 ? capacity : 1))),
+        size_(0),
+        capacity_(capacity) {}
+
+    /*
+      Destroys the handlers and frees their storage.
+     */
+    virtual ~ColumnBlock() {
+      for (size_t i = size_; i > 0; i--) {
+        handlers_[i - 1].~ColumnHandler();
+      }
+      ::operator delete(handlers_);
+    }
+
+    /*
+      Constructs the next handler in place with the arguments passed.
+     */
+    template <class... Args>
+    void emplace_back(Args&&... args) {
+      if (size_ == capacity_) {
+        throw std::logic_error("column block is full");
+      }
+      new (handlers_ + size_) ColumnHandler(std::forward<Args>(args)...);
+      size_++;
+    }
+
+    /*
+      Returns the handler of a column.
+     */
+    ColumnHandler &operator[](size_t column_index) {
+      return handlers_[column_index];
+    }
+
+    /*
+      Returns a pointer to the first handler.
+     */
+    ColumnHandler *data() {
+      return handlers_;
+    }
+
+    /*
+      Returns the number of handlers constructed so far.
+     */
+    size_t size() const {
+      return size_;
+    }
+
+    /*
+      Returns a pointer for each handler of ``block``. Each pointer shares
+      ownership of the whole block, so the block lives until the last of
+      them is released.
+     */
+    static std::vector<std::shared_ptr<ColumnHandler> > share(const std::shared_ptr<ColumnBlock> &block) {
+      std::vector<std::shared_ptr<ColumnHandler> > handlers;
+      handlers.reserve(block->size());
+      for (size_t i = 0; i < block->size(); i++) {
+        handlers.push_back(std::shared_ptr<ColumnHandler>(block, block->data() + i));
+      }
+      return handlers;
+    }
+
+  private:
+    ColumnBlock(const ColumnBlock &);
+    ColumnBlock &operator=(const ColumnBlock &);
+
+  private:
+    ColumnHandler *handlers_;
+    size_t size_;
+    size_t capacity_;
+  };
+}
+}
+#endif
@@ -34,6 +34,7 @@
 #include <unordered_set>
 
 #include "util/strings.hpp"
+#include "generic/dialect.hpp"
 
 namespace ParaText {
 
@@ -57,6 +58,7 @@ namespace CSV {
     /*
       Opens a file and parses its header.
      */
+    template <class Dialect = CommaDialect>
     void open(const std::string &filename, bool no_header) {
       struct stat fs;
       if (stat(filename.c_str(), &fs) == -1) {
@@ -71,7 +73,7 @@ namespace CSV {
         ostr << "cannot open file '" << filename << "'";
         throw std::logic_error(ostr.str());
       }
-      parse_header(no_header);
+      parse_header<Dialect>(no_header);
     }
 
     /*
@@ -82,13 +84,19 @@ namespace CSV {
     }
     
     /*
-      Adds a column of a specified name.
+      Adds a column of a specified name. Backslash escapes in the name
+      are decoded if ``unescape`` is true.
      */
-    void add_column_name(const std::string &name) {
+    void add_column_name(const std::string &name, bool unescape = true) {
       //std::cerr << "col " << column_names_.size() << ": " << name << std::endl;
 
       std::string transformed_name;
-      parse_unquoted_string(name.begin(), name.end(), std::back_inserter(transformed_name));
+      if (unescape) {
+        parse_unquoted_string(name.begin(), name.end(), std::back_inserter(transformed_name));
+      }
+      else {
+        transformed_name = name;
+      }
       convert_null_to_space(transformed_name.begin(), transformed_name.end());
       column_names_.push_back(transformed_name);
     }
@@ -101,8 +109,9 @@ namespace CSV {
     }
     
     /*
-      Parses a header.
+      Parses a header written in the ``Dialect``.
      */
+    template <class Dialect = CommaDialect>
     void parse_header(bool no_header=false) {
       std::string token;
       size_t current = 0;
@@ -114,6 +123,7 @@ namespace CSV {
       char *buf = (char *)_malloca(block_size);
 #endif
       char quote_started = 0;
+      bool quote_closed = false;
       bool eoh_encountered = false;
       bool soh_encountered = false;
       in_.seekg(0, std::ios_base::beg);
@@ -131,7 +141,7 @@ namespace CSV {
         size_t i = 0;
         /* ignore leading whitespace in the file. */
         while (i < nread && !soh_encountered) {
-          if (isspace(buf[i])) {
+          if (isspace(buf[i]) && buf[i] != Dialect::delimiter) {
             i++; /* eat the whitespace. */
           } else {
             soh_encountered = true;
@@ -144,12 +154,13 @@ namespace CSV {
               if (escape_jump > 0) {
                 escape_jump--;
               }
-              else if (buf[i] == '\\') {
+              else if (Dialect::backslash_escapes && buf[i] == '\\') {
                 escape_jump = 1;
               }
               else if (buf[i] == quote_started) {
                 i++;
                 quote_started = 0;
+                quote_closed = true;
                 break;
               }
               token.push_back(buf[i]);
@@ -157,26 +168,32 @@ namespace CSV {
           }
           else {
             for (; i < nread; i++) {
+              /* A quote right after a closing quote is a doubled quote. */
+              const bool after_closing_quote = quote_closed;
+              quote_closed = false;
               if (escape_jump > 0) {
                 token.push_back(buf[i]);
                 escape_jump--;
               }
-              else if (buf[i] == '\\') {
+              else if (Dialect::backslash_escapes && buf[i] == '\\') {
                 token.push_back(buf[i]);
                 escape_jump = 1;
               }
-              else if (buf[i] == '\"' || buf[i] == '\'') {
+              else if (buf[i] == Dialect::quote || (Dialect::backslash_escapes && buf[i] == '\'')) {
+                if (Dialect::doubled_quotes && after_closing_quote) {
+                  token.push_back(buf[i]);
+                }
                 quote_started = buf[i];
                 i++;
                 break;
               }
-              else if (buf[i] == ',') {
-                add_column_name(token);
+              else if (buf[i] == Dialect::delimiter) {
+                add_column_name(token, Dialect::backslash_escapes);
                 token.clear();
               }              
               else if (buf[i] == '\r') { /* do nothing: dos wastes a byte each line. */ }
               else if (buf[i] == '\n') {
-                add_column_name(token);
+                add_column_name(token, Dialect::backslash_escapes);
                 token.clear();
                 end_of_header_ = current + i;
                 eoh_encountered = true;
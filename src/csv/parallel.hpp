@@ -28,6 +28,10 @@
 #define PARATEXT_PARALLEL_HPP
 
 #include <algorithm>
+#include <vector>
+#include <mutex>
+
+#include "util/thread_pool.hpp"
 
 /*
  * Same as std::for_each but fun must have signature: void f(Iterator).
@@ -40,7 +44,8 @@ inline F for_each_it(Iterator first, Iterator last, F &&fun) {
 }
 
 /*
- * Distributes the application of F in [first, last) among different threads.
+ * Distributes the application of F in [first, last) among different threads
+ * of the process-wide ThreadPool.
  */
 template <class Iterator, class F>
 F parallel_for_each(Iterator first, Iterator last, size_t suggested_num_threads, F &&f) {
@@ -55,26 +60,81 @@ F parallel_for_each(Iterator first, Iterator last, size_t suggested_num_threads,
   const std::size_t elements_thread = num_elements / num_threads;
   const std::size_t excess = num_elements % num_threads;
 
-  /* Thread pool */
-  std::vector<std::thread> thread_pool;
-  thread_pool.reserve(num_threads);
-
-  /* Spawn threads */
+  /* Submit one task per thread to the pool */
+  ParaText::TaskGroup tasks;
   Iterator it = first;
   for (std::size_t thread_id = 0; thread_id < num_threads; ++thread_id) {
     const std::size_t step = elements_thread + (thread_id < excess ? 1 : 0);
-    thread_pool
-        .emplace_back([ it, step, thread_id, f = std::forward<F>(f) ]() {
-            for_each_it(it, it + step, std::bind(f, _1, thread_id));
-        });
+    tasks.run([ it, step, thread_id, &f ]() {
+        for_each_it(it, it + step, std::bind(f, _1, thread_id));
+      });
     it += step;
   }
 
-  /* Join threads */
-  for (auto &&thread : thread_pool) {
-    thread.join();
-  }
+  /* Wait for the tasks */
+  tasks.wait();
   return std::move(f);
 }
 
+/*
+ * Calls f(index, thread_id) for every index in [0, num_tasks) on up to
+ * suggested_num_threads threads of the process-wide ThreadPool. Each thread starts with a contiguous range
+ * of indices and takes them from the front. A thread that runs out steals
+ * from the back of the range of another thread, so a few slow tasks do not
+ * leave the other threads idle.
+ */
+template <class F>
+void parallel_for_each_stealing(size_t num_tasks, size_t suggested_num_threads, F &&f) {
+  if (num_tasks == 0) {
+    return;
+  }
+  const size_t num_threads =
+      std::min(std::max((size_t)1, suggested_num_threads), num_tasks);
+
+  /* The tasks still owned by each thread: [front, back). */
+  struct TaskRange {
+    size_t front;
+    size_t back;
+    std::mutex lock;
+  };
+  std::vector<TaskRange> ranges(num_threads);
+  for (size_t thread_id = 0; thread_id < num_threads; thread_id++) {
+    ranges[thread_id].front = num_tasks * thread_id / num_threads;
+    ranges[thread_id].back = num_tasks * (thread_id + 1) / num_threads;
+  }
+
+  auto run = [&ranges, &f, num_threads](size_t thread_id) {
+    while (true) {
+      size_t task = 0;
+      bool found = false;
+      {
+        TaskRange &own = ranges[thread_id];
+        std::unique_lock<std::mutex> guard(own.lock);
+        if (own.front < own.back) {
+          task = own.front++;
+          found = true;
+        }
+      }
+      for (size_t k = 1; !found && k < num_threads; k++) {
+        TaskRange &victim = ranges[(thread_id + k) % num_threads];
+        std::unique_lock<std::mutex> guard(victim.lock);
+        if (victim.front < victim.back) {
+          task = --victim.back;
+          found = true;
+        }
+      }
+      if (!found) {
+        return;
+      }
+      f(task, thread_id);
+    }
+  };
+
+  ParaText::TaskGroup tasks;
+  for (size_t thread_id = 0; thread_id < num_threads; thread_id++) {
+    tasks.run(std::bind(run, thread_id));
+  }
+  tasks.wait();
+}
+
 #endif
@@ -138,7 +138,7 @@ public:
             }
             else if (state < 5) {
               input.push_back(1);
-              double val = bsd_strtod(token.begin(), token.end());
+              double val = parse_double(token.begin(), token.end());
               unsigned char *bb = (unsigned char *)(void*)&val;
               input.insert(input.end(), bb, bb + sizeof(double));
             }
@@ -41,6 +41,7 @@
 #include <sstream>
 
 #include "generic/chunker.hpp"
+#include "util/thread_pool.hpp"
 #include "csv/header_parser.hpp"
 
 namespace ParaText {
@@ -106,7 +107,7 @@ private:
     virtual ~MemCopyBaseline() {}
 
     void load(const std::string &filename, const ParseParams &params) {
-      std::vector<std::thread> threads;
+      TaskGroup tasks;
       std::vector<std::shared_ptr<MemCopyWorker> > workers;
       header_parser_.open(filename, params.no_header);
       std::exception_ptr thread_exception;
@@ -124,13 +125,12 @@ private:
           continue;
         }
         workers.push_back(std::make_shared<MemCopyWorker>(start_of_chunk, end_of_chunk, params.block_size));
-        threads.emplace_back(&MemCopyWorker::parse,
-                             workers.back(),
-                             filename);
+        tasks.run(std::bind(&MemCopyWorker::parse,
+                            workers.back(),
+                            filename));
       }
-
-      for (size_t i = 0; i < threads.size(); i++) {
-        threads[i].join();
+      tasks.wait();
+      for (size_t i = 0; i < workers.size(); i++) {
         if (!thread_exception) {
           thread_exception = workers[i]->get_exception();
         }
@@ -132,7 +132,7 @@ public:
   // No type checking
   template <bool TypeCheck_, class Iterator>
   inline typename std::enable_if<!TypeCheck_, double>::type parse_token(Iterator begin, Iterator end) const {
-    return bsd_strtod(begin, end);
+    return parse_double(begin, end);
   }
 
   // Type checking only for numbers.
@@ -154,7 +154,7 @@ public:
         if (*it == '-') { it++; }
         for (; it != end && isdigit(*it); it++) {}
         if (it != end && (*it == '.' || *it == 'E' || *it == 'e')) {
-          return bsd_strtod(begin, end);
+          return parse_double(begin, end);
         }
         else {
           return (double)fast_atoi<long long>(begin, end);
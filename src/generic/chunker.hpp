@@ -37,9 +37,17 @@
     #include <unistd.h>
 #endif
 #include <thread>
+#include <mutex>
 #include <sstream>
 #include <vector>
+#include <cstring>
+#include <algorithm>
 
+#include "generic/parse_params.hpp"
+#include "generic/dialect.hpp"
+#include "util/range_reader.hpp"
+#include "util/thread_pool.hpp"
+#include "csv/parallel.hpp"
 #include "quote_adjustment_worker.hpp"
 
 namespace ParaText {
@@ -55,7 +63,7 @@ namespace ParaText {
     /*
       Constructs a new chunker with no chunk boundaries initialized.
      */
-    TextChunker()          {}
+    TextChunker() : sampled_newlines_(0), sampled_bytes_(0) {}
 
     /*
       Destroys this text chunker.
@@ -69,11 +77,20 @@ namespace ParaText {
       \param starting_offset   The starting offset of the first chunk.
       \param maximum_chunks    The maximum number of chunks. The number of chunks
                                will be as close to this number as possible.
+      \param io_method         If DIRECT_READ, the file is read around the page cache.
+      \param resolve_quotes    If false and quoted newlines are allowed, the chunks
+                               are left unaligned to records and the caller must
+                               resolve the quote state at the start of each chunk.
+                               This saves a pass over the file.
+
+      The ``Dialect`` decides which characters quote and escape.
      */
-    void process(const std::string &filename, size_t starting_offset, size_t maximum_chunks, bool allow_quoted_newlines) {
+    template <class Dialect = CommaDialect>
+    void process(const std::string &filename, size_t starting_offset, size_t maximum_chunks, bool allow_quoted_newlines, IOMethod io_method = IOMethod::BUFFERED_READ, bool resolve_quotes = true) {
       filename_ = filename;
       starting_offset_ = starting_offset;
       maximum_chunks_ = maximum_chunks;
+      io_method_ = io_method;
       struct stat fs;
       if (stat(filename.c_str(), &fs) == -1) {
         std::ostringstream ostr;
@@ -87,13 +104,9 @@ namespace ParaText {
       else {
         lastpos_ = 0;
       }
-      in_.open(filename.c_str(), std::ios::binary);
-      if (!in_) {
-        std::ostringstream ostr;
-        ostr << "cannot open file '" << filename << "'";
-        throw std::logic_error(ostr.str());
-      }
-      compute_offsets(allow_quoted_newlines);
+      sampled_newlines_ = 0;
+      sampled_bytes_ = 0;
+      compute_offsets<Dialect>(allow_quoted_newlines, resolve_quotes);
     }
 
     /*
@@ -111,180 +124,300 @@ namespace ParaText {
       return std::make_pair(start_of_chunk_[index], end_of_chunk_[index]);
     }
 
+    /*
+      Estimates the number of records in a chunk from the density of
+      newlines in the windows read to align the chunks. Quoted newlines
+      are counted as records, so it may be an overestimate. Returns 0 if
+      nothing was sampled, which is the case when quoted newlines are
+      allowed.
+     */
+    size_t estimate_num_records(size_t index) const {
+      if (sampled_bytes_ == 0 || start_of_chunk_[index] < 0 || end_of_chunk_[index] < 0) {
+        return 0;
+      }
+      const double length = (double)(end_of_chunk_[index] - start_of_chunk_[index] + 1);
+      return (size_t)(length * sampled_newlines_ / sampled_bytes_) + 1;
+    }
+
   private:
-    std::pair<long long, char> get_num_trailing_escapes(long long start_of_chunk, long long end_of_chunk) {
+    /*
+      Returns the number of consecutive backslashes that end at
+      ``end_of_chunk`` and the byte that follows them. The backslashes are
+      found with one read of a window that ends just past the chunk; only
+      a run of backslashes longer than the window needs another read.
+     */
+    std::pair<long long, char> get_num_trailing_escapes(RangeReader &reader, long long end_of_chunk) {
       long long num_trailing_escapes = 0;
-      long long k = end_of_chunk;
       char successor = 0;
-      if (end_of_chunk < lastpos_) {
-        in_.clear();
-        in_.seekg(end_of_chunk + 1, std::ios_base::beg);
-        in_.read(&successor, 1);
-      }
-
-      for (; k >= start_of_chunk; k--) {
-        in_.clear();
-        in_.seekg(k, std::ios_base::beg);
-        char buf;
-        in_.read(&buf, 1);
-        size_t nread = in_.gcount();
-        if (nread == 0 || buf != '\\') {
+      bool successor_read = false;
+      std::vector<char> window(escape_window_size + 1);
+      long long window_end = end_of_chunk;
+      while (window_end >= starting_offset_) {
+        const long long window_begin = std::max(starting_offset_, window_end - (long long)escape_window_size + 1);
+        const size_t length = (window_end - window_begin + 1) + (successor_read ? 0 : 1);
+        const size_t nread = reader.read(window_begin, length, window.data());
+        if (!successor_read) {
+          if (window_end < lastpos_ && nread == length) {
+            successor = window[length - 1];
+          }
+          successor_read = true;
+        }
+        long long k = std::min(window_end, window_begin + (long long)nread - 1);
+        for (; k >= window_begin && window[k - window_begin] == '\\'; k--) {
+          num_trailing_escapes++;
+        }
+        if (k >= window_begin) {
           break;
         }
-        num_trailing_escapes++;
+        window_end = window_begin - 1;
       }
       return std::make_pair(num_trailing_escapes, successor);
     }
 
-    void compute_offsets(bool allow_quoted_newlines = true) {
+    /*
+      Returns the number of bytes an escape sequence takes after the
+      backslash, given the character that follows the backslash.
+     */
+    static long long get_escape_length(char successor) {
+      switch (successor) {
+      case 'x': /* \xYY */
+        return 3;
+      case 'u': /* \uXXXX */
+        return 5;
+      case 'U': /* \UXXXXXXXX */
+        return 9;
+      case 'n':
+      case '0':
+      case 'r':
+      case 'v':
+      case 't':
+      case 'b':
+      case '\\':
+      case '\"':
+      case '\'':
+      case '{':
+      case '}':
+      case ' ':
+      case ',':
+      case ')':
+      case '(':
+      case '\n': /* a backslash before a quoted newline */
+      case '\r':
+        return 1;
+      default:
+        {
+          std::ostringstream ostr;
+          ostr << "invalid escape character: \\" << successor;
+          throw std::logic_error(ostr.str());
+        }
+      }
+    }
+
+    template <class Dialect>
+    void compute_offsets(bool allow_quoted_newlines = true, bool resolve_quotes = true) {
       const size_t chunk_size = std::max(2LL, (long long)((length_ - starting_offset_) / maximum_chunks_));
-      long long start_of_chunk = starting_offset_;
 #ifdef PARALOAD_DEBUG
       std::cerr << "number of threads: " << maximum_chunks_ << std::endl;
       std::cerr << "length: " << length_ << std::endl;
 #endif
-      for (size_t worker_id = 0; worker_id < maximum_chunks_; worker_id++) {
-        long long end_of_chunk = std::min(lastpos_, start_of_chunk + (long long)chunk_size);
-        if (end_of_chunk < start_of_chunk) {
-          start_of_chunk = lastpos_ + 1;
-          end_of_chunk = lastpos_ + 1;
-          start_of_chunk_.push_back(start_of_chunk);
-          end_of_chunk_.push_back(end_of_chunk);
-          break;
+      if (starting_offset_ > lastpos_) {
+        start_of_chunk_.push_back(lastpos_ + 1);
+        end_of_chunk_.push_back(lastpos_ + 1);
+      }
+      else {
+        compute_initial_offsets<Dialect>(chunk_size);
+      }
+      if (allow_quoted_newlines) {
+        if (resolve_quotes) {
+          adjust_offsets_according_to_quoted_newlines<Dialect>();
         }
+      }
+      else {
+        adjust_offsets_according_to_unquoted_newlines();
+      }
+      for (size_t chunk_id = 0; chunk_id < start_of_chunk_.size(); chunk_id++) {
 #ifdef PARALOAD_DEBUG
-        std::cerr << "initial>>> start_of_chunk: " << start_of_chunk << " end_of_chunk: " << end_of_chunk << std::endl;
+        std::cerr << "final>>> start_of_chunk: " << start_of_chunk_[chunk_id] << " end_of_chunk: " << end_of_chunk_[chunk_id] << std::endl;
 #endif
+      }
+    }
+
+    /*
+      Divides the file into chunks of about ``chunk_size`` bytes that do
+      not split an escape sequence.
+     */
+    template <class Dialect>
+    void compute_initial_offsets(size_t chunk_size) {
+      /*
+        Lay out the initial boundaries one byte further apart than the chunk
+        size so that each can independently be moved forward by a byte.
+       */
+      std::vector<long long> ends;
+      for (size_t worker_id = 0; worker_id < maximum_chunks_; worker_id++) {
+        long long end_of_chunk = std::min(lastpos_, starting_offset_ + (long long)(worker_id * (chunk_size + 1) + chunk_size));
         if (worker_id == maximum_chunks_ - 1) {
           end_of_chunk = lastpos_;
         }
-        long long trailing_escapes;
-        char trailing_successor;
-        std::tie(trailing_escapes, trailing_successor) = get_num_trailing_escapes(start_of_chunk, end_of_chunk);
-        if (trailing_escapes % 2 == 1) {
-          long long extra = 0;
-          switch (trailing_successor) {
-          case 'x': /* \xYY */
-            extra = 3;
-            break;
-          case 'u': /* \uXXXX */
-            extra = 5;
-            break;
-          case 'U': /* \UXXXXXXXX */
-            extra = 9;
-            break;
-          case 'n':
-          case '0':
-          case 'r':
-          case 'v':
-          case 't':
-          case 'b':
-          case '\\':
-          case '\"':
-          case '\'':
-          case '{':
-          case '}':
-          case ' ':
-          case ',':
-          case ')':
-          case '(':
-            extra = 1;
-            break;
-          default:
-            {
+        ends.push_back(end_of_chunk);
+        if (end_of_chunk >= lastpos_) {
+          break;
+        }
+      }
+      /*
+        A boundary that falls right after an unescaped backslash would split
+        an escape sequence; the boundaries are checked in parallel, each with
+        its own reader. Dialects without backslash escapes skip the check.
+       */
+      std::vector<std::unique_ptr<RangeReader> > readers(ends.size());
+      std::vector<size_t> boundaries;
+      if (Dialect::backslash_escapes) {
+        for (size_t worker_id = 0; worker_id < ends.size(); worker_id++) {
+          boundaries.push_back(worker_id);
+        }
+      }
+      std::exception_ptr thread_exception;
+      std::mutex thread_exception_lock;
+      parallel_for_each(boundaries.begin(), boundaries.end(), maximum_chunks_,
+                        [&](decltype(boundaries.begin()) it, size_t thread_id) mutable {
+        try {
+          if (!readers[thread_id]) {
+            readers[thread_id].reset(new RangeReader(filename_, io_method_));
+          }
+          long long &end_of_chunk = ends[*it];
+          long long trailing_escapes;
+          char trailing_successor;
+          std::tie(trailing_escapes, trailing_successor) = get_num_trailing_escapes(*readers[thread_id], end_of_chunk);
+          if (trailing_escapes % 2 == 1) {
+            const long long extra = get_escape_length(trailing_successor);
+            if (end_of_chunk + extra > lastpos_) {
               std::ostringstream ostr;
-              ostr << "invalid escape character: \\" << trailing_successor;
+              ostr << "file ends with a trailing escape sequence \\" << trailing_successor;
               throw std::logic_error(ostr.str());
             }
-          }
-          if (end_of_chunk + extra > lastpos_) {
-            std::ostringstream ostr;
-            ostr << "file ends with a trailing escape sequence \\" << trailing_successor;
-            throw std::logic_error(ostr.str());
-          }
-          else {
             end_of_chunk++;
 #ifdef PARALOAD_DEBUG
             std::cerr << "cover escape: " << end_of_chunk << std::endl;
 #endif
           }
         }
-        start_of_chunk_.push_back(start_of_chunk);
-        end_of_chunk_.push_back(end_of_chunk);
-        if (end_of_chunk >= lastpos_) {
-          break;
+        catch (...) {
+          std::unique_lock<std::mutex> guard(thread_exception_lock);
+          thread_exception = std::current_exception();
         }
-        start_of_chunk = end_of_chunk + 1;
-      }
-      if (allow_quoted_newlines) {
-        adjust_offsets_according_to_quoted_newlines();
-      }
-      else {
-        adjust_offsets_according_to_unquoted_newlines();
+      });
+      if (thread_exception) {
+        std::rethrow_exception(thread_exception);
       }
-      for (size_t chunk_id = 0; chunk_id < start_of_chunk_.size(); chunk_id++) {
+      long long start_of_chunk = starting_offset_;
+      for (size_t worker_id = 0; worker_id < ends.size(); worker_id++) {
 #ifdef PARALOAD_DEBUG
-        std::cerr << "final>>> start_of_chunk: " << start_of_chunk_[chunk_id] << " end_of_chunk: " << end_of_chunk_[chunk_id] << std::endl;
+        std::cerr << "initial>>> start_of_chunk: " << start_of_chunk << " end_of_chunk: " << ends[worker_id] << std::endl;
 #endif
+        start_of_chunk_.push_back(start_of_chunk);
+        end_of_chunk_.push_back(ends[worker_id]);
+        if (ends[worker_id] >= lastpos_) {
+          break;
+        }
+        start_of_chunk = ends[worker_id] + 1;
       }
     }
 
+    /*
+      Moves the end of each chunk forward to the next newline. The newlines
+      are found in parallel, one window read per boundary in the common
+      case, and the chunks are then merged in a single pass: a chunk whose
+      end was overtaken by the previous chunk's new end is dropped, and
+      the next surviving chunk starts right after it.
+     */
     void adjust_offsets_according_to_unquoted_newlines() {
-      const size_t block_size = 512;
-      char buf[block_size];
+      std::vector<long long> new_ends(start_of_chunk_.size(), -1);
+      std::vector<std::pair<size_t, size_t> > samples(start_of_chunk_.size());
+      std::vector<std::unique_ptr<RangeReader> > readers(start_of_chunk_.size());
+      std::vector<size_t> boundaries;
       for (size_t worker_id = 0; worker_id < start_of_chunk_.size(); worker_id++) {
-        if (start_of_chunk_[worker_id] < 0 || end_of_chunk_[worker_id] < 0) {
-          continue;
+        if (start_of_chunk_[worker_id] >= 0 && end_of_chunk_[worker_id] >= 0) {
+          boundaries.push_back(worker_id);
         }
-        in_.clear();
-        in_.seekg(end_of_chunk_[worker_id], std::ios_base::beg);
-        long long new_end = end_of_chunk_[worker_id];
-        bool new_end_found = false;
-        long long current = new_end;
-        while (in_ && !new_end_found) {
-          in_.read(buf, block_size);
-          size_t nread = in_.gcount();
-          if (nread == 0) {
-            break;
-          }
-          for (size_t i = 0; i < nread; i++) {
-            if (buf[i] == '\n') {
-              new_end = current + i;
-              new_end_found = true;
-            break;
-            }
+      }
+      std::exception_ptr thread_exception;
+      std::mutex thread_exception_lock;
+      parallel_for_each(boundaries.begin(), boundaries.end(), maximum_chunks_,
+                        [&](decltype(boundaries.begin()) it, size_t thread_id) mutable {
+        try {
+          if (!readers[thread_id]) {
+            readers[thread_id].reset(new RangeReader(filename_, io_method_));
           }
-          current += nread;
+          new_ends[*it] = find_next_newline(*readers[thread_id], end_of_chunk_[*it], samples[*it]);
         }
-        if (!new_end_found) {
-          new_end = lastpos_;
+        catch (...) {
+          std::unique_lock<std::mutex> guard(thread_exception_lock);
+          thread_exception = std::current_exception();
         }
-        end_of_chunk_[worker_id] = new_end;
-        for (size_t other_worker_id = worker_id + 1; other_worker_id < start_of_chunk_.size(); other_worker_id++) {
-          if (end_of_chunk_[other_worker_id] <= new_end || new_end == lastpos_) {
-            start_of_chunk_[other_worker_id] = -1;
-            end_of_chunk_[other_worker_id] = -1;
-          } else if (start_of_chunk_[other_worker_id] <= new_end) {            
-            start_of_chunk_[other_worker_id] = new_end + 1;
-            end_of_chunk_[other_worker_id] = std::max(end_of_chunk_[other_worker_id], new_end + 1);
-          }
+      });
+      if (thread_exception) {
+        std::rethrow_exception(thread_exception);
+      }
+      for (size_t k = 0; k < samples.size(); k++) {
+        sampled_newlines_ += samples[k].first;
+        sampled_bytes_ += samples[k].second;
+      }
+      long long previous_end = -1;
+      for (size_t k = 0; k < boundaries.size(); k++) {
+        const size_t worker_id = boundaries[k];
+        if (previous_end >= 0 && (previous_end == lastpos_ || end_of_chunk_[worker_id] <= previous_end)) {
+          start_of_chunk_[worker_id] = -1;
+          end_of_chunk_[worker_id] = -1;
+          continue;
         }
+        if (previous_end >= 0 && start_of_chunk_[worker_id] <= previous_end) {
+          start_of_chunk_[worker_id] = previous_end + 1;
+        }
+        end_of_chunk_[worker_id] = new_ends[worker_id];
+        previous_end = new_ends[worker_id];
+      }
+    }
+
+    /*
+      Returns the offset of the first newline at or after ``offset``, or
+      the last position of the file if there is none. The number of
+      newlines and bytes in the first window read are stored in
+      ``sample`` if the window is full.
+     */
+    long long find_next_newline(RangeReader &reader, long long offset, std::pair<size_t, size_t> &sample) {
+      std::vector<char> buf(newline_window_size);
+      long long current = offset;
+      while (true) {
+        const size_t nread = reader.read(current, buf.size(), buf.data());
+        if (current == offset && nread == buf.size()) {
+          sample.first = std::count(buf.data(), buf.data() + nread, '\n');
+          sample.second = nread;
+        }
+        if (nread == 0) {
+          return lastpos_;
+        }
+        const char *newline = (const char *)memchr(buf.data(), '\n', nread);
+        if (newline != NULL) {
+          return current + (newline - buf.data());
+        }
+        current += nread;
       }
     }
 
+    template <class Dialect>
     void adjust_offsets_according_to_quoted_newlines() {
-      std::vector<std::thread> threads;
-      std::vector<std::shared_ptr<QuoteNewlineAdjustmentWorker> > workers;
+      typedef QuoteNewlineAdjustmentWorker<Dialect> worker_type;
+      TaskGroup tasks;
+      std::vector<std::shared_ptr<worker_type> > workers;
       std::exception_ptr thread_exception;
       for (size_t worker_id = 0; worker_id < start_of_chunk_.size(); worker_id++) {
-        workers.push_back(std::make_shared<QuoteNewlineAdjustmentWorker>(start_of_chunk_[worker_id],
-                                                                         end_of_chunk_[worker_id]));
-        threads.emplace_back(&QuoteNewlineAdjustmentWorker::parse, workers.back(), filename_);
+        workers.push_back(std::make_shared<worker_type>(start_of_chunk_[worker_id],
+                                                        end_of_chunk_[worker_id]));
+        tasks.run(std::bind(&worker_type::parse, workers.back(), filename_, io_method_));
       }
-      for (size_t thread_id = 0; thread_id < threads.size(); thread_id++) {
-        threads[thread_id].join();
+      tasks.wait();
+      for (size_t worker_id = 0; worker_id < workers.size(); worker_id++) {
         if (!thread_exception) {
-          thread_exception = workers[thread_id]->get_exception();
+          thread_exception = workers[worker_id]->get_exception();
         }
       }
       for (size_t chunk_id = 0; chunk_id < workers.size(); chunk_id++) {
@@ -390,8 +523,15 @@ namespace ParaText {
       }
     }
 
+    /*
+      How far back a boundary is first read to find the backslashes that
+      end its chunk, and how far forward to find the newline after it.
+     */
+    static const size_t escape_window_size = 4096;
+    static const size_t newline_window_size = 65536;
+
   private:
-    std::ifstream in_;
+    IOMethod io_method_;
     std::string filename_;
     size_t maximum_chunks_;
     size_t length_;
@@ -399,6 +539,8 @@ namespace ParaText {
     long long starting_offset_;
     std::vector<long long> start_of_chunk_;
     std::vector<long long> end_of_chunk_;
+    size_t sampled_newlines_;
+    size_t sampled_bytes_;
   };
 }
 #endif
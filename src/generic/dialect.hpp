@@ -0,0 +1,51 @@
+/*
+    ParaText: parallel text reading
+    Copyright (C) 2016. wise.io, Inc.
+
+   Licensed to the Apache Software Foundation (ASF) under one
+   or more contributor license agreements.  See the NOTICE file
+   distributed with this work for additional information
+   regarding copyright ownership.  The ASF licenses this file
+   to you under the Apache License, Version 2.0 (the
+   "License"); you may not use this file except in compliance
+   with the License.  You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing,
+   software distributed under the License is distributed on an
+   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+   KIND, either express or implied.  See the License for the
+   specific language governing permissions and limitations
+   under the License.
+ */
+
+#ifndef PARATEXT_DIALECT_HPP
+#define PARATEXT_DIALECT_HPP
+
+#include "generic/parse_params.hpp"
+
+namespace ParaText {
+
+  /*
+    The characters that structure a delimited text file. A dialect is a
+    template parameter of the tokenizers rather than a runtime setting,
+    so the delimiter and the escape rules are constants in their inner
+    loops and the code for escapes a dialect does not use is compiled
+    out.
+   */
+  template <char Delimiter, EscapeStyle Escape = EscapeStyle::BACKSLASH_ESCAPE>
+  struct Dialect {
+    static const char delimiter = Delimiter;
+    static const char quote = '\"';
+    static const bool backslash_escapes = Escape == EscapeStyle::BACKSLASH_ESCAPE;
+    static const bool doubled_quotes = Escape == EscapeStyle::DOUBLED_QUOTE_ESCAPE;
+  };
+
+  typedef Dialect<','> CommaDialect;
+  typedef Dialect<'\t'> TabDialect;
+  typedef Dialect<'|'> PipeDialect;
+  typedef Dialect<';'> SemicolonDialect;
+  typedef Dialect<',', EscapeStyle::DOUBLED_QUOTE_ESCAPE> RFC4180Dialect;
+}
+#endif
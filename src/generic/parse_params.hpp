@@ -39,6 +39,45 @@ namespace ParaText {
 
   typedef enum {CATEGORICAL, NUMERIC, TEXT, UNKNOWN} Semantics;
 
+  /*
+    How parse workers obtain the bytes of their chunk: by copying blocks
+    out of a buffered stream, by tokenizing a memory-mapped view of
+    the file directly, by parsing blocks read ahead by a shared pool of
+    reader threads, or by reading around the page cache. DIRECT_READ also
+    applies to chunking.
+   */
+  typedef enum {BUFFERED_READ, MEMORY_MAPPED, ASYNC_READ, DIRECT_READ} IOMethod;
+
+  /*
+    How floating point values are stored. FLOAT32_ALWAYS rounds every
+    value to single precision. FLOAT32_IF_LOSSLESS keeps single
+    precision for a column only while all of its values are exact in
+    it, and widens the column to double otherwise. FLOAT64_ALWAYS stores
+    the same way but returns every floating point column as double.
+    Integers are never rounded in any mode.
+   */
+  typedef enum {FLOAT32_ALWAYS, FLOAT32_IF_LOSSLESS, FLOAT64_ALWAYS} FloatPrecision;
+
+  /*
+    How a quote is written inside a quoted field. With BACKSLASH_ESCAPE
+    it is preceded by a backslash, which escapes other characters too.
+    With DOUBLED_QUOTE_ESCAPE it is written twice, as in RFC 4180, and
+    backslashes are ordinary characters.
+   */
+  typedef enum {BACKSLASH_ESCAPE, DOUBLED_QUOTE_ESCAPE} EscapeStyle;
+
+  /*
+    How a field is compared with a constant in a row filter.
+   */
+  typedef enum {EQUAL_TO, NOT_EQUAL_TO, LESS_THAN, LESS_EQUAL, GREATER_THAN, GREATER_EQUAL} Comparison;
+
+  /*
+    The type in which a numeric column is stored. With INFERRED_TYPE the
+    narrowest type that holds every value exactly is chosen while
+    parsing; any other type is used as declared, without widening.
+   */
+  typedef enum {INFERRED_TYPE, UINT8_TYPE, INT8_TYPE, UINT16_TYPE, INT16_TYPE, UINT32_TYPE, INT32_TYPE, UINT64_TYPE, INT64_TYPE, FLOAT32_TYPE, FLOAT64_TYPE} StorageType;
+
   template <class T, int InEncoding, int OutEncoding>
   struct TagEncoding {};
 
@@ -48,7 +87,7 @@ namespace ParaText {
   };
 
   struct ParseParams {
-    ParseParams() : no_header(false), number_only(false), convert_null_to_space(true), block_size(32768), num_threads(16), allow_quoted_newlines(false),  max_level_name_length(std::numeric_limits<size_t>::max()), max_levels(std::numeric_limits<size_t>::max()), compression(Compression::NONE), parser_type(ParserType::COL_BASED) {}
+    ParseParams() : no_header(false), number_only(false), convert_null_to_space(true), block_size(32768), num_threads(16), allow_quoted_newlines(false),  max_level_name_length(std::numeric_limits<size_t>::max()), max_levels(std::numeric_limits<size_t>::max()), compression(Compression::NONE), parser_type(ParserType::COL_BASED), io_method(IOMethod::BUFFERED_READ), num_read_ahead_blocks(4), speculative_quotes(true), chunks_per_thread(4), float_precision(FloatPrecision::FLOAT32_ALWAYS), delimiter(','), escape_style(EscapeStyle::BACKSLASH_ESCAPE), skip_rows(0), max_rows(std::numeric_limits<size_t>::max()), num_schema_samples(8) {}
     bool no_header;
     bool number_only;
     bool compute_sum;
@@ -60,6 +99,16 @@ namespace ParaText {
     size_t max_levels;
     Compression compression;
     ParserType parser_type;
+    IOMethod io_method;
+    size_t num_read_ahead_blocks;
+    bool speculative_quotes;
+    size_t chunks_per_thread;
+    FloatPrecision float_precision;
+    char delimiter;
+    EscapeStyle escape_style;
+    size_t skip_rows;
+    size_t max_rows;
+    size_t num_schema_samples;
   };
 
 }
@@ -28,9 +28,28 @@
 #define PARATEXT_QUOTE_NEWLINE_WORKER_HPP
 
 #include <cassert>
+#include <memory>
+
+#include "generic/parse_params.hpp"
+#include "generic/dialect.hpp"
+#include "util/direct_file_reader.hpp"
+#include "util/byte_masks.hpp"
 
 namespace ParaText {
 
+/*
+  Whether a byte range of a file begins inside a quoted field. Parse
+  workers that are handed a chunk before its quote state is known
+  either guess it or are told it.
+ */
+typedef enum {UNKNOWN_QUOTE_STATE, OUTSIDE_QUOTES, INSIDE_QUOTES} QuoteState;
+
+/*
+  Counts the unescaped quotes of a chunk and finds its first quoted and
+  unquoted newlines. A doubled quote of an RFC 4180 dialect counts as two
+  quotes, which leaves the parity of the count unchanged.
+ */
+template <class Dialect = CommaDialect>
 class QuoteNewlineAdjustmentWorker {
 public:
   QuoteNewlineAdjustmentWorker(size_t chunk_start, size_t chunk_end)
@@ -38,13 +57,15 @@ public:
       chunk_end_(chunk_end),
       num_quotes_(0),
       first_unquoted_newline_(-1),
-      first_quoted_newline_(-1) {}
+      first_quoted_newline_(-1),
+      prev_escaped_(0),
+      in_quote_(0) {}
 
   virtual ~QuoteNewlineAdjustmentWorker() {}
 
-  void parse(const std::string &filename) {
+  void parse(const std::string &filename, IOMethod io_method) {
     try {
-      parse_impl(filename);
+      parse_impl(filename, io_method);
     }
     catch (...) {
       thread_exception_ = std::current_exception();
@@ -55,210 +76,84 @@ public:
     return thread_exception_;
   }
 
-  void parse_impl(const std::string &filename) {
+  void parse_impl(const std::string &filename, IOMethod io_method) {
     std::ifstream in;
-    in.open(filename.c_str(), std::ios::binary);
+    std::unique_ptr<DirectFileReader> direct_in;
     const size_t block_size = 32768;
-    char buf[block_size];
-    in.seekg(chunk_start_, std::ios_base::beg);
+    char block[block_size];
+    if (io_method == IOMethod::DIRECT_READ) {
+      direct_in.reset(new DirectFileReader(filename));
+    }
+    else {
+      in.open(filename.c_str(), std::ios::binary);
+      in.seekg(chunk_start_, std::ios_base::beg);
+    }
     size_t current = chunk_start_;
-    size_t escape_count = 0;
-    bool in_quote = false;
+    prev_escaped_ = 0;
+    in_quote_ = 0;
     while (current <= chunk_end_) {
-      in.read(buf, std::min(chunk_end_ - current + 1, block_size));
-      size_t nread = in.gcount();
-      if (nread == 0) {
-        break;
-      }
-      size_t i = 0;
-      while (i < nread && first_unquoted_newline_ < 0 && first_quoted_newline_ < 0) {
-        if (in_quote) {
-          for (; i < nread; i++) {
-            if (escape_count > 0) {
-              escape_count--;
-            }
-            else if (buf[i] == '\\') {
-              escape_count = 1;
-            }
-            else if (buf[i] == '\"') {
-              num_quotes_++;
-#ifdef PARATEXT_DEBUG_QUOTE
-              std::cerr << "[Q1:" << (current + i) << ":" << num_quotes_ << ":" << escape_count;
-#endif
-              in_quote = false;
-              i++;
-              break;
-            }
-            else if (buf[i] == '\n') {
-              first_quoted_newline_ = current + i;
-              i++;
-              break;
-            }
-          }
-        }
-        else {
-          for (; i < nread; i++) {
-            if (escape_count > 0) {
-              escape_count--;
-            }
-            else if (buf[i] == '\\') {
-              escape_count = 1;
-            }
-            else if (buf[i] == '\"') {
-              num_quotes_++;
-#ifdef PARATEXT_DEBUG_QUOTE
-              std::cerr << "[Q2:" << (current + i) << ":" << num_quotes_ << ":" << escape_count;
-#endif
-              in_quote = true;
-              i++;
-              break;
-            }
-            else if (buf[i] == '\n') {
-              first_unquoted_newline_ = current + i;
-              i++;
-              break;
-            }
-          }
-        }
-      }
-      while (i < nread && first_unquoted_newline_ < 0) {
-        if (in_quote) {
-          for (; i < nread; i++) {
-            if (escape_count > 0) {
-              escape_count--;
-            }
-            else if (buf[i] == '\\') {
-              escape_count = 1;
-            }
-            else if (buf[i] == '\"') {
-              num_quotes_++;
-#ifdef PARATEXT_DEBUG_QUOTE
-              std::cerr << "[Q3:" << (current + i) << ":" << num_quotes_ << ":" << escape_count;
-#endif
-              in_quote = false;
-              i++;
-              break;
-            }
-          }
-        }
-        else {
-          for (; i < nread; i++) {
-            if (escape_count > 0) {
-              escape_count--;
-            }
-            else if (buf[i] == '\\') {
-              escape_count = 1;
-            }
-            else if (buf[i] == '\"') {
-              num_quotes_++;
-#ifdef PARATEXT_DEBUG_QUOTE
-              std::cerr << "[Q4:" << (current + i) << ":" << num_quotes_ << ":" << escape_count;
-#endif
-              in_quote = true;
-              i++;
-              break;
-            }
-            else if (buf[i] == '\n') {
-              first_unquoted_newline_ = current + i;
-              i++;
-              break;
-            }
-          }
-        }
+      /* After the first read, reads start on block boundaries. */
+      const size_t length = std::min(chunk_end_ - current + 1, block_size - current % block_size);
+      const char *buf = block;
+      size_t nread = 0;
+      if (direct_in) {
+        nread = direct_in->read(current, length, buf);
       }
-      while (i < nread && first_quoted_newline_ < 0) {
-        if (in_quote) {
-          for (; i < nread; i++) {
-            if (escape_count > 0) {
-              escape_count--;
-            }
-            else if (buf[i] == '\\') {
-              escape_count = 1;
-            }
-            else if (buf[i] == '\"') {
-              num_quotes_++;
-#ifdef PARATEXT_DEBUG_QUOTE
-              std::cerr << "[Q5:" << (current + i) << ":" << num_quotes_ << ":" << escape_count;
-#endif
-              in_quote = false;
-              i++;
-              break;
-            }
-            else if (buf[i] == '\n') {
-              first_quoted_newline_ = current + i;
-              i++;
-              break;
-            }
-          }
-        }
-        else {
-          for (; i < nread; i++) {
-            if (escape_count > 0) {
-              escape_count--;
-            }
-            else if (buf[i] == '\\') {
-              escape_count = 1;
-            }
-            else if (buf[i] == '\"') {
-              num_quotes_++;
-#ifdef PARATEXT_DEBUG_QUOTE
-              std::cerr << "[Q6:" << (current + i) << ":" << num_quotes_ << ":" << escape_count;
-#endif
-              in_quote = true;
-              i++;
-              break;
-            }
-          }
-        }
+      else {
+        in.read(block, length);
+        nread = in.gcount();
       }
-      /*
-        If we got here, then either we've found both the first quoted newline and 
-        unquoted newline, or we've processed all the data in the buffer.
-      */
-      while (i < nread) {
-        if (in_quote) {
-          for (; i < nread; i++) {
-            if (escape_count > 0) {
-              escape_count--;
-            }
-            else if (buf[i] == '\\') {
-              escape_count = 1;
-            }
-            else if (buf[i] == '\"') {
-              num_quotes_++;
-#ifdef PARATEXT_DEBUG_QUOTE
-              std::cerr << "[Q7:" << (current + i) << ":" << num_quotes_ << ":" << escape_count;
-#endif
-              in_quote = false;
-              i++;
-              break;
-            } 
-          }
-        }
-        else {
-          for (; i < nread; i++) {
-            if (escape_count > 0) {
-              escape_count--;
-            }
-            else if (buf[i] == '\\') {
-              escape_count = 1;
-            }
-            else if (buf[i] == '\"') {
-              num_quotes_++;
-#ifdef PARATEXT_DEBUG_QUOTE
-              std::cerr << "[Q8:" << (current + i) << ":" << num_quotes_ << ":" << escape_count;
-#endif
-              in_quote = true;
-              i++;
-              break;
-            }
-          }
-        }
+      if (nread == 0) {
+        break;
       }
+      scan_block(buf, nread, current);
       current += nread;
     }
   }
 
+  /*
+    Scans ``nread`` bytes that start at file offset ``current``. Blocks
+    must be passed in file order, starting at the beginning of the chunk.
+   */
+  void scan_block(const char *buf, size_t nread, size_t current) {
+    size_t i = 0;
+    for (; i + ByteBlock64::size <= nread; i += ByteBlock64::size) {
+      scan(ByteBlock64(buf + i), ByteBlock64::size, current + i);
+    }
+    if (i < nread) {
+      char tail[ByteBlock64::size] = {0};
+      std::copy(buf + i, buf + nread, tail);
+      scan(ByteBlock64(tail), nread - i, current + i);
+    }
+  }
+
+  /*
+    Scans the first ``n`` bytes of a 64-byte block that starts at file
+    offset ``offset``. Quote parity and escapes carry over from the
+    previous block.
+   */
+  void scan(const ByteBlock64 &block, size_t n, size_t offset) {
+    const uint64_t valid = low_bits_mask(n);
+    uint64_t escaped = 0;
+    if (Dialect::backslash_escapes) {
+      escaped = find_escaped(block.eq('\\') & valid, prev_escaped_);
+      if (n < ByteBlock64::size) {
+        prev_escaped_ = (escaped >> n) & 1;
+      }
+    }
+    const uint64_t quotes = block.eq(Dialect::quote) & ~escaped & valid;
+    const uint64_t newlines = block.eq('\n') & ~escaped & valid;
+    const uint64_t quoted = prefix_xor(quotes) ^ in_quote_;
+    in_quote_ = (uint64_t)((int64_t)quoted >> 63);
+    num_quotes_ += count_ones(quotes);
+    if (first_quoted_newline_ < 0 && (newlines & quoted) != 0) {
+      first_quoted_newline_ = offset + lowest_bit_index(newlines & quoted);
+    }
+    if (first_unquoted_newline_ < 0 && (newlines & ~quoted) != 0) {
+      first_unquoted_newline_ = offset + lowest_bit_index(newlines & ~quoted);
+    }
+  }
+
   size_t get_start() const {
     return chunk_start_;
   }
@@ -304,6 +199,8 @@ private:
   size_t num_quotes_;
   long long first_unquoted_newline_;
   long long first_quoted_newline_;
+  uint64_t prev_escaped_;
+  uint64_t in_quote_;
   std::exception_ptr thread_exception_;
 };
 }
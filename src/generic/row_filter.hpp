@@ -0,0 +1,199 @@
+/*
+    ParaText: parallel text reading
+    Copyright (C) 2016. wise.io, Inc.
+
+   Licensed to the Apache Software Foundation (ASF) under one
+   or more contributor license agreements.  See the NOTICE file
+   distributed with this work for additional information
+   regarding copyright ownership.  The ASF licenses this file
+   to you under the Apache License, Version 2.0 (the
+   "License"); you may not use this file except in compliance
+   with the License.  You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing,
+   software distributed under the License is distributed on an
+   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+   KIND, either express or implied.  See the License for the
+   specific language governing permissions and limitations
+   under the License.
+ */
+
+#ifndef PARATEXT_ROW_FILTER_HPP
+#define PARATEXT_ROW_FILTER_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <limits>
+#include <cstring>
+#include <algorithm>
+#include "generic/parse_params.hpp"
+#include "util/token_classifier.hpp"
+
+namespace ParaText {
+
+  /*
+    A predicate on the fields of a record, evaluated while parsing so
+    that records which fail it are never stored.
+
+    The predicate is an OR of conjunctions, each an AND of comparisons
+    between a field and a constant. A comparison with a number holds
+    only if the text of the field is a number; any other text compares
+    as NaN, so only NOT_EQUAL_TO holds for it. A comparison with a
+    string compares bytes, which orders ISO 8601 dates correctly.
+   */
+  class RowFilter {
+  public:
+    RowFilter() {}
+
+    /*
+      Adds a comparison of a field with a number to the conjunction
+      ``conjunction``.
+     */
+    void add_comparison(size_t conjunction, size_t field, Comparison comparison, double number) {
+      Clause clause(get_slot(field), comparison);
+      clause.numeric = true;
+      clause.number = number;
+      clause.integral = number >= (double)std::numeric_limits<long long>::min()
+        && number < -(double)std::numeric_limits<long long>::min()
+        && (double)(long long)number == number;
+      clause.integer = clause.integral ? (long long)number : 0;
+      get_conjunction(conjunction).push_back(clause);
+    }
+
+    /*
+      Adds a comparison of a field with a string to the conjunction
+      ``conjunction``.
+     */
+    void add_comparison(size_t conjunction, size_t field, Comparison comparison, const std::string &text) {
+      Clause clause(get_slot(field), comparison);
+      clause.text = text;
+      get_conjunction(conjunction).push_back(clause);
+    }
+
+    /*
+      Returns whether there are no comparisons, in which case every
+      record is kept.
+     */
+    bool empty() const {
+      for (size_t i = 0; i < conjunctions_.size(); i++) {
+        if (conjunctions_[i].size() > 0) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    /*
+      Returns the fields that the comparisons read, each listed once.
+     */
+    const std::vector<size_t> &get_fields() const {
+      return fields_;
+    }
+
+    /*
+      Returns whether a record is kept. ``field_text[i]`` is the
+      unescaped text of the field ``get_fields()[i]``.
+     */
+    bool accepts(const std::vector<std::pair<const char *, const char *> > &field_text) const {
+      for (size_t i = 0; i < conjunctions_.size(); i++) {
+        const std::vector<Clause> &clauses = conjunctions_[i];
+        if (clauses.size() == 0) {
+          continue;
+        }
+        bool holds = true;
+        for (size_t j = 0; j < clauses.size() && holds; j++) {
+          holds = evaluate(clauses[j], field_text[clauses[j].slot].first, field_text[clauses[j].slot].second);
+        }
+        if (holds) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+  private:
+    struct Clause {
+      Clause(size_t slot, Comparison comparison)
+        : slot(slot), comparison(comparison), numeric(false), integral(false), integer(0), number(0.0) {}
+      size_t slot;
+      Comparison comparison;
+      bool numeric;
+      bool integral;
+      long long integer;
+      double number;
+      std::string text;
+    };
+
+    size_t get_slot(size_t field) {
+      auto it = std::find(fields_.begin(), fields_.end(), field);
+      if (it == fields_.end()) {
+        fields_.push_back(field);
+        return fields_.size() - 1;
+      }
+      return it - fields_.begin();
+    }
+
+    std::vector<Clause> &get_conjunction(size_t conjunction) {
+      if (conjunction >= conjunctions_.size()) {
+        conjunctions_.resize(conjunction + 1);
+      }
+      return conjunctions_[conjunction];
+    }
+
+    template <class T>
+    static bool compare(const T &left, const T &right, Comparison comparison) {
+      switch (comparison) {
+      case Comparison::EQUAL_TO:
+        return left == right;
+      case Comparison::NOT_EQUAL_TO:
+        return left != right;
+      case Comparison::LESS_THAN:
+        return left < right;
+      case Comparison::LESS_EQUAL:
+        return left <= right;
+      case Comparison::GREATER_THAN:
+        return left > right;
+      default:
+        return left >= right;
+      }
+    }
+
+    static bool evaluate(const Clause &clause, const char *begin, const char *end) {
+      if (!clause.numeric) {
+        const size_t length = end - begin;
+        const size_t common = std::min(length, clause.text.size());
+        int order = common > 0 ? std::memcmp(begin, clause.text.data(), common) : 0;
+        if (order == 0) {
+          order = length < clause.text.size() ? -1 : (length > clause.text.size() ? 1 : 0);
+        }
+        return compare(order, 0, clause.comparison);
+      }
+      long long integer_value = 0;
+      unsigned long long unsigned_value = 0;
+      double float_value = 0.0;
+      switch (TokenClassifier::classify(begin, end, integer_value, unsigned_value, float_value)) {
+      case TokenKind::SIGNED_INTEGER_TOKEN:
+        if (clause.integral) {
+          return compare(integer_value, clause.integer, clause.comparison);
+        }
+        return compare((double)integer_value, clause.number, clause.comparison);
+      case TokenKind::UNSIGNED_INTEGER_TOKEN:
+        return compare((double)unsigned_value, clause.number, clause.comparison);
+      case TokenKind::INTEGER_OVERFLOW_TOKEN:
+        return compare(::parse_double(begin, end), clause.number, clause.comparison);
+      case TokenKind::FLOAT_TOKEN:
+        return compare(float_value, clause.number, clause.comparison);
+      default:
+        return compare(std::numeric_limits<double>::quiet_NaN(), clause.number, clause.comparison);
+      }
+    }
+
+  private:
+    std::vector<size_t> fields_;
+    std::vector<std::vector<Clause> > conjunctions_;
+  };
+}
+#endif
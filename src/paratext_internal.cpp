@@ -19,6 +19,7 @@
 
 #include "paratext_internal.hpp"
 #include "util/strings.hpp"
+#include "util/thread_pool.hpp"
 
 #include <string>
 #include <type_traits>
@@ -33,6 +34,14 @@ size_t get_num_cores() {
   return std::thread::hardware_concurrency();
 }
 
+void set_thread_pool_size(size_t num_threads) {
+  ParaText::ThreadPool::get_instance().set_num_threads(num_threads);
+}
+
+size_t get_thread_pool_size() {
+  return ParaText::ThreadPool::get_instance().get_num_threads();
+}
+
 std::string as_quoted_string(const std::string &s, bool do_not_escape_newlines) {
   return get_quoted_string(s.begin(), s.end(), true, do_not_escape_newlines);
 }
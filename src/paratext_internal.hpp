@@ -25,6 +25,9 @@
 
 size_t get_num_cores();
 
+void set_thread_pool_size(size_t num_threads);
+size_t get_thread_pool_size();
+
 std::string as_quoted_string(const std::string &s, bool do_not_escape_newlines = false);
 
 ParaText::as_raw_bytes get_random_string(size_t length, long seed, long min = 0, long max = 255);
@@ -261,13 +261,13 @@ namespace ParaText {
   double get_as_float(const npy_ucs4 *buf, size_t item_size) {
     (void)buf;
     std::string s(get_as_string(buf, item_size));
-    return ::bsd_strtod(s.begin(), s.end());
+    return ::parse_double(s.begin(), s.end());
   }
   
   double get_as_float(const char *buf, size_t item_size) {
     (void)buf;
     std::string s(get_as_string(buf, item_size));
-    return ::bsd_strtod(s.begin(), s.end());
+    return ::parse_double(s.begin(), s.end());
   }
   
   long long get_as_long(const npy_ucs4 *buf, size_t item_size) {
@@ -317,7 +317,7 @@ namespace ParaText {
       char *buf;
       Py_ssize_t length;
       PyBytes_AsCharString(obj, &buf, &length);
-      retval = ::bsd_strtod(buf, buf + length);
+      retval = ::parse_double(buf, buf + length);
     }
     else if (PyUnicode_Check(obj)) {
       PyRefGuard temp(PyUnicode_AsUTF8String(obj));
@@ -326,7 +326,7 @@ namespace ParaText {
       }
       char *buf = PyString_AsString(temp.get());
       auto size = PyUnicode_GET_DATA_SIZE(temp.get());
-      retval = ::bsd_strtod(buf, buf + size);
+      retval = ::parse_double(buf, buf + size);
     }
     else {
       throw std::string("cannot handle item");
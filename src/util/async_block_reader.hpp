@@ -0,0 +1,197 @@
+/*
+    ParaText: parallel text reading
+    Copyright (C) 2016. wise.io, Inc.
+
+   Licensed to the Apache Software Foundation (ASF) under one
+   or more contributor license agreements.  See the NOTICE file
+   distributed with this work for additional information
+   regarding copyright ownership.  The ASF licenses this file
+   to you under the Apache License, Version 2.0 (the
+   "License"); you may not use this file except in compliance
+   with the License.  You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing,
+   software distributed under the License is distributed on an
+   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+   KIND, either express or implied.  See the License for the
+   specific language governing permissions and limitations
+   under the License.
+ */
+
+#ifndef PARATEXT_ASYNC_BLOCK_READER_HPP
+#define PARATEXT_ASYNC_BLOCK_READER_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <exception>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+
+#include "util/thread_pool.hpp"
+
+namespace ParaText {
+
+  /*
+    Reads the bytes [begin, end] of a file into a ring of blocks so
+    that a parse worker can tokenize one block while the next ones are
+    being read. The reads run as tasks of ThreadPool::get_io_instance():
+    a task fills the free blocks and returns, and next() starts another
+    once it frees a block, so readers share a bounded set of threads
+    rather than each holding one of its own. After the first block,
+    every read starts at a multiple of the block size.
+
+    Blocks are consumed strictly in order with next(). A block returned
+    by next() stays valid until the following call to next().
+   */
+  class AsyncBlockReader {
+  public:
+    /*
+      Opens the file and starts reading ahead.
+
+      \param filename     The file to read.
+      \param begin        The offset of the first byte to read.
+      \param end          The offset of the last byte to read (inclusive).
+      \param block_size   The maximum number of bytes in a block.
+      \param num_blocks   The number of blocks that may be in flight at once.
+     */
+    AsyncBlockReader(const std::string &filename, size_t begin, size_t end, size_t block_size, size_t num_blocks)
+      : end_(end),
+        current_(begin),
+        block_size_(std::max((size_t)1, block_size)),
+        buffers_(std::max((size_t)2, num_blocks)),
+        sizes_(buffers_.size(), 0),
+        filled_(buffers_.size(), false),
+        slot_(0),
+        read_slot_(0),
+        holding_(false),
+        exhausted_(false),
+        reading_(false),
+        stop_(false) {
+      in_.open(filename.c_str(), std::ios::binary);
+      if (!in_) {
+        std::ostringstream ostr;
+        ostr << "cannot open file '" << filename << "'";
+        throw std::logic_error(ostr.str());
+      }
+      for (size_t i = 0; i < buffers_.size(); i++) {
+        buffers_[i].resize(block_size_);
+      }
+      in_.seekg(current_, std::ios_base::beg);
+      std::unique_lock<std::mutex> guard(mutex_);
+      resume_reading();
+    }
+
+    /*
+      Stops reading ahead and waits for a read in progress to finish.
+     */
+    virtual ~AsyncBlockReader() {
+      std::unique_lock<std::mutex> guard(mutex_);
+      stop_ = true;
+      cond_.wait(guard, [this]() { return !reading_; });
+    }
+
+    /*
+      Releases the previously returned block and waits for the next one.
+      Returns the number of bytes in the block, or 0 once the range has
+      been exhausted.
+     */
+    size_t next(const char *&buf) {
+      std::unique_lock<std::mutex> guard(mutex_);
+      if (holding_) {
+        filled_[slot_] = false;
+        slot_ = (slot_ + 1) % buffers_.size();
+        holding_ = false;
+        resume_reading();
+      }
+      cond_.wait(guard, [this]() { return filled_[slot_] || thread_exception_; });
+      if (!filled_[slot_]) {
+        std::rethrow_exception(thread_exception_);
+      }
+      holding_ = true;
+      buf = buffers_[slot_].data();
+      return sizes_[slot_];
+    }
+
+  private:
+    /*
+      Submits a read task unless one is running or nothing is left to
+      read. Called with mutex_ held.
+     */
+    void resume_reading() {
+      if (!reading_ && !exhausted_ && !stop_ && !thread_exception_) {
+        reading_ = true;
+        ThreadPool::get_io_instance().submit([this]() { read_ahead(); });
+      }
+    }
+
+    /*
+      Fills blocks until the ring is full or the range is exhausted. At
+      most one of these runs at a time, so it alone touches in_ and
+      current_. It touches nothing once reading_ is cleared, after which
+      the reader may be destroyed.
+     */
+    void read_ahead() {
+      try {
+        while (true) {
+          size_t slot = 0;
+          {
+            std::unique_lock<std::mutex> guard(mutex_);
+            if (stop_ || exhausted_ || filled_[read_slot_]) {
+              reading_ = false;
+              cond_.notify_all();
+              return;
+            }
+            slot = read_slot_;
+          }
+          size_t nread = 0;
+          if (current_ <= end_) {
+            in_.read(buffers_[slot].data(), std::min(end_ - current_ + 1, block_size_ - current_ % block_size_));
+            nread = in_.gcount();
+          }
+          current_ += nread;
+          std::unique_lock<std::mutex> guard(mutex_);
+          sizes_[slot] = nread;
+          filled_[slot] = true;
+          exhausted_ = nread == 0;
+          read_slot_ = (slot + 1) % buffers_.size();
+          cond_.notify_all();
+        }
+      }
+      catch (...) {
+        std::unique_lock<std::mutex> guard(mutex_);
+        thread_exception_ = std::current_exception();
+        reading_ = false;
+        cond_.notify_all();
+      }
+    }
+
+  private:
+    AsyncBlockReader(const AsyncBlockReader &);
+    AsyncBlockReader &operator=(const AsyncBlockReader &);
+
+  private:
+    std::ifstream in_;
+    size_t end_;
+    size_t current_;
+    size_t block_size_;
+    std::vector<std::vector<char> > buffers_;
+    std::vector<size_t> sizes_;
+    std::vector<bool> filled_;
+    size_t slot_;
+    size_t read_slot_;
+    bool holding_;
+    bool exhausted_;
+    bool reading_;
+    bool stop_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::exception_ptr thread_exception_;
+  };
+}
+#endif
@@ -0,0 +1,175 @@
+/*
+    ParaText: parallel text reading
+    Copyright (C) 2016. wise.io, Inc.
+
+   Licensed to the Apache Software Foundation (ASF) under one
+   or more contributor license agreements.  See the NOTICE file
+   distributed with this work for additional information
+   regarding copyright ownership.  The ASF licenses this file
+   to you under the Apache License, Version 2.0 (the
+   "License"); you may not use this file except in compliance
+   with the License.  You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing,
+   software distributed under the License is distributed on an
+   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+   KIND, either express or implied.  See the License for the
+   specific language governing permissions and limitations
+   under the License.
+ */
+
+#ifndef PARATEXT_BYTE_MASKS_HPP
+#define PARATEXT_BYTE_MASKS_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+#endif
+
+namespace ParaText {
+
+  /*
+    A block of 64 bytes that can be compared against a character to
+    produce a 64-bit mask. Bit i of a mask corresponds to byte i of
+    the block. The comparisons use SSE2 or AVX2 when available.
+   */
+  class ByteBlock64 {
+  public:
+    static const size_t size = 64;
+
+    /*
+      Loads 64 bytes starting at ``p``.
+     */
+    explicit ByteBlock64(const char *p) {
+#if defined(__AVX2__)
+      lo_ = _mm256_loadu_si256((const __m256i *)p);
+      hi_ = _mm256_loadu_si256((const __m256i *)(p + 32));
+#elif defined(__SSE2__) || defined(_M_X64)
+      v0_ = _mm_loadu_si128((const __m128i *)p);
+      v1_ = _mm_loadu_si128((const __m128i *)(p + 16));
+      v2_ = _mm_loadu_si128((const __m128i *)(p + 32));
+      v3_ = _mm_loadu_si128((const __m128i *)(p + 48));
+#else
+      std::memcpy(bytes_, p, size);
+#endif
+    }
+
+    /*
+      Returns a mask of the bytes equal to ``c``.
+     */
+    inline uint64_t eq(char c) const {
+#if defined(__AVX2__)
+      const __m256i m = _mm256_set1_epi8(c);
+      uint64_t lo = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo_, m));
+      uint64_t hi = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi_, m));
+      return lo | (hi << 32);
+#elif defined(__SSE2__) || defined(_M_X64)
+      const __m128i m = _mm_set1_epi8(c);
+      uint64_t r0 = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v0_, m));
+      uint64_t r1 = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v1_, m));
+      uint64_t r2 = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v2_, m));
+      uint64_t r3 = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v3_, m));
+      return r0 | (r1 << 16) | (r2 << 32) | (r3 << 48);
+#else
+      uint64_t result = 0;
+      for (size_t i = 0; i < size; i++) {
+        result |= (uint64_t)(bytes_[i] == c) << i;
+      }
+      return result;
+#endif
+    }
+
+  private:
+#if defined(__AVX2__)
+    __m256i lo_;
+    __m256i hi_;
+#elif defined(__SSE2__) || defined(_M_X64)
+    __m128i v0_;
+    __m128i v1_;
+    __m128i v2_;
+    __m128i v3_;
+#else
+    char bytes_[64];
+#endif
+  };
+
+  /*
+    Returns a mask whose bit i is the parity of the bits 0..i of ``x``.
+    Applied to a mask of quote characters, it marks the bytes that are
+    inside a quoted region (including the opening quote).
+   */
+  inline uint64_t prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+  }
+
+  /*
+    Given a mask of backslashes, returns the mask of the characters
+    escaped by them. A backslash escapes the character after it unless
+    it is itself escaped, so only odd-length runs of backslashes escape
+    the character that follows the run.
+
+    ``prev_escaped`` carries state between consecutive blocks: it is 1
+    if the first byte of this block is escaped by the previous block.
+   */
+  inline uint64_t find_escaped(uint64_t backslash, uint64_t &prev_escaped) {
+    const uint64_t even_bits = 0x5555555555555555ULL;
+    backslash &= ~prev_escaped;
+    const uint64_t follows_escape = (backslash << 1) | prev_escaped;
+    const uint64_t odd_sequence_starts = backslash & ~even_bits & ~follows_escape;
+    const uint64_t sequences_starting_on_even_bits = odd_sequence_starts + backslash;
+    prev_escaped = sequences_starting_on_even_bits < odd_sequence_starts ? 1 : 0;
+    const uint64_t invert_mask = sequences_starting_on_even_bits << 1;
+    return (even_bits ^ invert_mask) & follows_escape;
+  }
+
+  /*
+    Returns the number of set bits.
+   */
+  inline size_t count_ones(uint64_t x) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#else
+    size_t count = 0;
+    for (; x != 0; x &= x - 1) {
+      count++;
+    }
+    return count;
+#endif
+  }
+
+  /*
+    Returns the index of the lowest set bit. ``x`` must not be zero.
+   */
+  inline size_t lowest_bit_index(uint64_t x) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#else
+    size_t index = 0;
+    for (; (x & 1) == 0; x >>= 1) {
+      index++;
+    }
+    return index;
+#endif
+  }
+
+  /*
+    Returns a mask with the lowest ``n`` bits set, for 0 <= n <= 64.
+   */
+  inline uint64_t low_bits_mask(size_t n) {
+    return n >= 64 ? ~0ULL : ((1ULL << n) - 1);
+  }
+}
+#endif
@@ -0,0 +1,192 @@
+/*
+    ParaText: parallel text reading
+    Copyright (C) 2016. wise.io, Inc.
+
+   Licensed to the Apache Software Foundation (ASF) under one
+   or more contributor license agreements.  See the NOTICE file
+   distributed with this work for additional information
+   regarding copyright ownership.  The ASF licenses this file
+   to you under the Apache License, Version 2.0 (the
+   "License"); you may not use this file except in compliance
+   with the License.  You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing,
+   software distributed under the License is distributed on an
+   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+   KIND, either express or implied.  See the License for the
+   specific language governing permissions and limitations
+   under the License.
+ */
+
+#ifndef PARATEXT_DIRECT_FILE_READER_HPP
+#define PARATEXT_DIRECT_FILE_READER_HPP
+
+#include <string>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
+#include <cerrno>
+#include <new>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+namespace ParaText {
+
+  /*
+    Reads byte ranges of a file without going through the page cache.
+
+    On Linux the file is opened with O_DIRECT, which requires the file
+    offset, the length and the buffer address of every read to be
+    multiples of the device block size. Callers may ask for any range;
+    the reader rounds the range out to an aligned superset, reads that
+    into an aligned buffer, and returns a pointer to the requested
+    bytes within it.
+
+    On file systems that reject O_DIRECT the file is read normally and
+    the pages read are dropped from the cache afterwards. On OS X the
+    F_NOCACHE flag is used instead.
+   */
+  class DirectFileReader {
+  public:
+    /*
+      Opens a file for direct reading.
+     */
+    DirectFileReader(const std::string &filename) : fd_(-1), direct_(false), buffer_(NULL), capacity_(0) {
+#ifndef _WIN32
+#ifdef O_DIRECT
+      fd_ = ::open(filename.c_str(), O_RDONLY | O_DIRECT);
+      direct_ = fd_ >= 0;
+      if (fd_ < 0 && errno == EINVAL) {
+        fd_ = ::open(filename.c_str(), O_RDONLY);
+      }
+#else
+      fd_ = ::open(filename.c_str(), O_RDONLY);
+#endif
+      if (fd_ < 0) {
+        std::ostringstream ostr;
+        ostr << "cannot open file '" << filename << "'";
+        throw std::logic_error(ostr.str());
+      }
+#ifdef F_NOCACHE
+      fcntl(fd_, F_NOCACHE, 1);
+#endif
+#else
+      (void)filename;
+      throw std::logic_error("direct input is not supported on this platform");
+#endif
+    }
+
+    /*
+      Closes the file and frees the aligned buffer.
+     */
+    virtual ~DirectFileReader() {
+#ifndef _WIN32
+      if (fd_ >= 0) {
+        ::close(fd_);
+      }
+      free(buffer_);
+#endif
+    }
+
+    /*
+      Reads up to ``length`` bytes starting at ``offset``. On return,
+      ``buf`` points to the first byte read. The bytes remain valid
+      until the next call to read(). Returns the number of bytes read,
+      which is less than ``length`` only at the end of the file.
+     */
+    size_t read(size_t offset, size_t length, const char *&buf) {
+      buf = NULL;
+#ifndef _WIN32
+      const size_t aligned_begin = offset - (offset % alignment);
+      const size_t aligned_end = round_up(offset + length);
+      const size_t aligned_length = aligned_end - aligned_begin;
+      reserve(aligned_length);
+      size_t total = 0;
+      while (total < aligned_length) {
+        ssize_t nread = pread(fd_, buffer_ + total, aligned_length - total, aligned_begin + total);
+        if (nread < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          throw std::logic_error("error reading file with direct I/O");
+        }
+        if (nread == 0) {
+          break;
+        }
+        total += nread;
+        /* A short read that is not block-aligned can only happen at EOF. */
+        if (total % alignment != 0) {
+          break;
+        }
+      }
+#if defined(POSIX_FADV_DONTNEED)
+      if (!direct_) {
+        posix_fadvise(fd_, aligned_begin, aligned_length, POSIX_FADV_DONTNEED);
+      }
+#endif
+      const size_t skip = offset - aligned_begin;
+      if (total <= skip) {
+        return 0;
+      }
+      buf = buffer_ + skip;
+      return std::min(length, total - skip);
+#else
+      (void)offset;
+      (void)length;
+      return 0;
+#endif
+    }
+
+    /*
+      Rounds a block size up to a multiple of the alignment so that
+      consecutive reads stay aligned.
+     */
+    static size_t round_up(size_t size) {
+      return ((size + alignment - 1) / alignment) * alignment;
+    }
+
+    /*
+      The alignment of offsets, lengths, and buffers. 4096 bytes covers
+      the logical block size of all common disks.
+     */
+    static const size_t alignment = 4096;
+
+  private:
+    void reserve(size_t size) {
+#ifndef _WIN32
+      if (size <= capacity_) {
+        return;
+      }
+      free(buffer_);
+      buffer_ = NULL;
+      capacity_ = 0;
+      void *ptr = NULL;
+      if (posix_memalign(&ptr, alignment, size) != 0) {
+        throw std::bad_alloc();
+      }
+      buffer_ = (char *)ptr;
+      capacity_ = size;
+#else
+      (void)size;
+#endif
+    }
+
+    DirectFileReader(const DirectFileReader &);
+    DirectFileReader &operator=(const DirectFileReader &);
+
+  private:
+    int fd_;
+    bool direct_;
+    char *buffer_;
+    size_t capacity_;
+  };
+}
+#endif
@@ -0,0 +1,139 @@
+/*
+    ParaText: parallel text reading
+    Copyright (C) 2016. wise.io, Inc.
+
+   Licensed to the Apache Software Foundation (ASF) under one
+   or more contributor license agreements.  See the NOTICE file
+   distributed with this work for additional information
+   regarding copyright ownership.  The ASF licenses this file
+   to you under the Apache License, Version 2.0 (the
+   "License"); you may not use this file except in compliance
+   with the License.  You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing,
+   software distributed under the License is distributed on an
+   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+   KIND, either express or implied.  See the License for the
+   specific language governing permissions and limitations
+   under the License.
+ */
+
+
+#ifndef PARATEXT_FAST_INTEGER_HPP
+#define PARATEXT_FAST_INTEGER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+
+namespace ParaText {
+
+  /*
+    What parse_integer() found: an integer that fits a long long, a
+    non-negative integer that only fits an unsigned long long, or an
+    integer too large for either.
+   */
+  typedef enum {SIGNED_INTEGER, UNSIGNED_INTEGER, INTEGER_OVERFLOW} IntegerKind;
+
+  /*
+    Returns true if ``c`` is an ASCII whitespace character. Unlike
+    std::isspace, this does not depend on the locale.
+   */
+  inline bool is_ascii_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+  }
+
+  /*
+    Loads 8 bytes as a little-endian 64-bit word.
+   */
+  inline uint64_t load_eight_bytes(const char *p) {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+  }
+
+  /*
+    Returns true if all bytes of a word loaded by load_eight_bytes()
+    are ASCII digits.
+   */
+  inline bool is_eight_digits(uint64_t word) {
+    return (((word & 0xF0F0F0F0F0F0F0F0ULL)
+             | (((word + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4))
+            == 0x3333333333333333ULL);
+  }
+
+  /*
+    Converts 8 ASCII digits to their value with three multiplications,
+    combining pairs of digits, then pairs of pairs, then the two halves.
+   */
+  inline uint32_t parse_eight_digits(uint64_t word) {
+    word = (word & 0x0F0F0F0F0F0F0F0FULL) * 2561 >> 8;
+    word = (word & 0x00FF00FF00FF00FFULL) * 6553601 >> 16;
+    return (uint32_t)((word & 0x0000FFFF0000FFFFULL) * 42949672960001ULL >> 32);
+  }
+
+  /*
+    Parses an optionally negative decimal integer. Leading whitespace is
+    skipped and parsing stops at the first character that is not a
+    digit, like fast_atoi().
+
+    The digits are consumed 8 at a time while at least 8 remain, and
+    one at a time after that. Up to 19 significant digits cannot
+    overflow; beyond that each digit is checked. An integer that fits a
+    long long is stored in ``value``, a larger non-negative one in
+    ``unsigned_value``.
+   */
+  inline IntegerKind parse_integer(const char *begin, const char *end, long long &value, unsigned long long &unsigned_value) {
+    const char *p = begin;
+    while (p != end && is_ascii_space(*p)) {
+      ++p;
+    }
+    bool negative = false;
+    if (p != end && *p == '-') {
+      negative = true;
+      ++p;
+    }
+    while (p != end && *p == '0') {
+      ++p;
+    }
+    uint64_t magnitude = 0;
+    size_t num_digits = 0;
+    while (num_digits < 16 && end - p >= 8) {
+      const uint64_t word = load_eight_bytes(p);
+      if (!is_eight_digits(word)) {
+        break;
+      }
+      magnitude = magnitude * 100000000ULL + parse_eight_digits(word);
+      p += 8;
+      num_digits += 8;
+    }
+    for (; p != end && (unsigned)(*p - '0') < 10; ++p, ++num_digits) {
+      const unsigned digit = *p - '0';
+      if (num_digits >= 19 && magnitude > (std::numeric_limits<uint64_t>::max() - digit) / 10) {
+        return IntegerKind::INTEGER_OVERFLOW;
+      }
+      magnitude = magnitude * 10 + digit;
+    }
+    const uint64_t max_magnitude = (uint64_t)std::numeric_limits<long long>::max();
+    if (negative) {
+      if (magnitude > max_magnitude + 1) {
+        return IntegerKind::INTEGER_OVERFLOW;
+      }
+      value = magnitude == max_magnitude + 1 ? std::numeric_limits<long long>::min() : -(long long)magnitude;
+      return IntegerKind::SIGNED_INTEGER;
+    }
+    if (magnitude > max_magnitude) {
+      unsigned_value = magnitude;
+      return IntegerKind::UNSIGNED_INTEGER;
+    }
+    value = (long long)magnitude;
+    return IntegerKind::SIGNED_INTEGER;
+  }
+}
+#endif
@@ -0,0 +1,162 @@
+/*
+    ParaText: parallel text reading
+    Copyright (C) 2016. wise.io, Inc.
+
+   Licensed to the Apache Software Foundation (ASF) under one
+   or more contributor license agreements.  See the NOTICE file
+   distributed with this work for additional information
+   regarding copyright ownership.  The ASF licenses this file
+   to you under the Apache License, Version 2.0 (the
+   "License"); you may not use this file except in compliance
+   with the License.  You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing,
+   software distributed under the License is distributed on an
+   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+   KIND, either express or implied.  See the License for the
+   specific language governing permissions and limitations
+   under the License.
+ */
+
+#ifndef PARATEXT_MAPPED_FILE_HPP
+#define PARATEXT_MAPPED_FILE_HPP
+
+#include <string>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+#endif
+
+namespace ParaText {
+
+  /*
+    A read-only memory-mapped view of a byte range of a file. Workers
+    use it to tokenize the file contents in place rather than copying
+    each block into a buffer of their own. The mapping is released
+    when the view is destroyed.
+   */
+  class MappedFileRegion {
+  public:
+    /*
+      Constructs an empty view.
+     */
+    MappedFileRegion() : base_(NULL), mapped_length_(0), data_(NULL), length_(0) {}
+
+    /*
+      Maps the bytes [begin, end] of a file. The ending index is inclusive
+      and is clipped to the end of the file.
+     */
+    MappedFileRegion(const std::string &filename, size_t begin, size_t end)
+      : base_(NULL), mapped_length_(0), data_(NULL), length_(0) {
+      open(filename, begin, end);
+    }
+
+    /*
+      Unmaps the view.
+     */
+    virtual ~MappedFileRegion() {
+      close();
+    }
+
+    /*
+      Maps the bytes [begin, end] of a file, releasing any previous mapping.
+     */
+    void open(const std::string &filename, size_t begin, size_t end) {
+      close();
+#ifndef _WIN32
+      int fd = ::open(filename.c_str(), O_RDONLY);
+      if (fd < 0) {
+        std::ostringstream ostr;
+        ostr << "cannot open file '" << filename << "'";
+        throw std::logic_error(ostr.str());
+      }
+      struct stat fs;
+      if (fstat(fd, &fs) == -1) {
+        ::close(fd);
+        std::ostringstream ostr;
+        ostr << "cannot stat file '" << filename << "'";
+        throw std::logic_error(ostr.str());
+      }
+      const size_t file_length = fs.st_size;
+      if (begin >= file_length || end < begin) {
+        ::close(fd);
+        return;
+      }
+      end = std::min(end, file_length - 1);
+      /* mmap requires the offset to be a multiple of the page size. */
+      const size_t page_size = sysconf(_SC_PAGESIZE);
+      const size_t aligned_begin = begin - (begin % page_size);
+      int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+      flags |= MAP_POPULATE;
+#endif
+      void *base = mmap(NULL, end - aligned_begin + 1, PROT_READ, flags, fd, aligned_begin);
+      ::close(fd);
+      if (base == MAP_FAILED) {
+        std::ostringstream ostr;
+        ostr << "cannot memory map file '" << filename << "'";
+        throw std::logic_error(ostr.str());
+      }
+      madvise(base, end - aligned_begin + 1, MADV_SEQUENTIAL);
+      base_ = base;
+      mapped_length_ = end - aligned_begin + 1;
+      data_ = (const char *)base + (begin - aligned_begin);
+      length_ = end - begin + 1;
+#else
+      (void)filename;
+      (void)begin;
+      (void)end;
+      throw std::logic_error("memory-mapped input is not supported on this platform");
+#endif
+    }
+
+    /*
+      Releases the mapping, if any.
+     */
+    void close() {
+#ifndef _WIN32
+      if (base_ != NULL) {
+        munmap(base_, mapped_length_);
+      }
+#endif
+      base_ = NULL;
+      mapped_length_ = 0;
+      data_ = NULL;
+      length_ = 0;
+    }
+
+    /*
+      Returns a pointer to the first byte of the requested range.
+     */
+    const char *data() const {
+      return data_;
+    }
+
+    /*
+      Returns the number of bytes in the mapped range.
+     */
+    size_t size() const {
+      return length_;
+    }
+
+  private:
+    MappedFileRegion(const MappedFileRegion &);
+    MappedFileRegion &operator=(const MappedFileRegion &);
+
+  private:
+    void *base_;
+    size_t mapped_length_;
+    const char *data_;
+    size_t length_;
+  };
+}
+#endif
@@ -0,0 +1,92 @@
+/*
+    ParaText: parallel text reading
+    Copyright (C) 2016. wise.io, Inc.
+
+   Licensed to the Apache Software Foundation (ASF) under one
+   or more contributor license agreements.  See the NOTICE file
+   distributed with this work for additional information
+   regarding copyright ownership.  The ASF licenses this file
+   to you under the Apache License, Version 2.0 (the
+   "License"); you may not use this file except in compliance
+   with the License.  You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing,
+   software distributed under the License is distributed on an
+   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+   KIND, either express or implied.  See the License for the
+   specific language governing permissions and limitations
+   under the License.
+ */
+
+
+#ifndef PARATEXT_RANGE_READER_HPP
+#define PARATEXT_RANGE_READER_HPP
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <memory>
+
+#include "generic/parse_params.hpp"
+#include "util/direct_file_reader.hpp"
+
+namespace ParaText {
+
+  /*
+    Reads arbitrary byte ranges of a file into a caller's buffer, through
+    a buffered stream or, for DIRECT_READ, around the page cache. A reader
+    is not thread-safe; each thread that reads should have its own.
+   */
+  class RangeReader {
+  public:
+    /*
+      Opens a file for reading.
+     */
+    RangeReader(const std::string &filename, IOMethod io_method) {
+      if (io_method == IOMethod::DIRECT_READ) {
+        direct_in_.reset(new DirectFileReader(filename));
+      }
+      else {
+        in_.open(filename.c_str(), std::ios::binary);
+        if (!in_) {
+          std::ostringstream ostr;
+          ostr << "cannot open file '" << filename << "'";
+          throw std::logic_error(ostr.str());
+        }
+      }
+    }
+
+    virtual ~RangeReader() {}
+
+    /*
+      Reads up to ``length`` bytes at ``offset`` into ``buf``. Returns the
+      number of bytes read, which is less than ``length`` only at the end
+      of the file.
+     */
+    size_t read(size_t offset, size_t length, char *buf) {
+      if (direct_in_) {
+        const char *data = NULL;
+        size_t nread = direct_in_->read(offset, length, data);
+        std::copy(data, data + nread, buf);
+        return nread;
+      }
+      in_.clear();
+      in_.seekg(offset, std::ios_base::beg);
+      in_.read(buf, length);
+      return in_.gcount();
+    }
+
+  private:
+    RangeReader(const RangeReader &);
+    RangeReader &operator=(const RangeReader &);
+
+  private:
+    std::ifstream in_;
+    std::unique_ptr<DirectFileReader> direct_in_;
+  };
+}
+#endif
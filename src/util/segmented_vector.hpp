@@ -0,0 +1,206 @@
+/*
+    ParaText: parallel text reading
+    Copyright (C) 2016. wise.io, Inc.
+
+   Licensed to the Apache Software Foundation (ASF) under one
+   or more contributor license agreements.  See the NOTICE file
+   distributed with this work for additional information
+   regarding copyright ownership.  The ASF licenses this file
+   to you under the Apache License, Version 2.0 (the
+   "License"); you may not use this file except in compliance
+   with the License.  You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing,
+   software distributed under the License is distributed on an
+   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+   KIND, either express or implied.  See the License for the
+   specific language governing permissions and limitations
+   under the License.
+ */
+
+#ifndef PARATEXT_SEGMENTED_VECTOR_HPP
+#define PARATEXT_SEGMENTED_VECTOR_HPP
+
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+#include <utility>
+
+/*
+ * The base 2 logarithm of n, rounded down.
+ */
+static constexpr size_t floor_log2(size_t n) {
+  return n <= 1 ? 0 : 1 + floor_log2(n / 2);
+}
+
+/*
+ * A vector stored as a list of segments of about 64 KB each, so that
+ * it grows without moving or copying its elements and without the
+ * spare capacity of a doubling vector.
+ *
+ * Only the first segment grows by reallocation, and only until it is
+ * full, so that short vectors stay small. Every segment but the last
+ * is full, so the element at an index is found with a shift and a mask.
+ */
+template <class T>
+class segmented_vector {
+public:
+  static const size_t segment_shift = floor_log2(sizeof(T) < 65536 ? 65536 / sizeof(T) : 1);
+  static const size_t segment_size = (size_t)1 << segment_shift;
+  static const size_t segment_mask = segment_size - 1;
+
+  segmented_vector() {}
+
+  size_t size() const {
+    return segments_.empty() ? 0 : ((segments_.size() - 1) << segment_shift) + segments_.back().size();
+  }
+
+  bool empty() const {
+    return segments_.empty() || segments_[0].empty();
+  }
+
+  /*
+   * The number of elements the allocated segments hold.
+   */
+  size_t capacity() const {
+    size_t result = 0;
+    for (size_t i = 0; i < segments_.size(); i++) {
+      result += segments_[i].capacity();
+    }
+    return result;
+  }
+
+  const T &operator[](size_t i) const {
+    return segments_[i >> segment_shift][i & segment_mask];
+  }
+
+  T &operator[](size_t i) {
+    return segments_[i >> segment_shift][i & segment_mask];
+  }
+
+  void push_back(const T &value) {
+    make_room();
+    segments_.back().push_back(value);
+  }
+
+  void push_back(T &&value) {
+    make_room();
+    segments_.back().push_back(std::move(value));
+  }
+
+  /*
+   * Appends a run of values, converting each to T.
+   */
+  template <class U>
+  void append(const U *begin, const U *end) {
+    while (begin != end) {
+      make_room();
+      std::vector<T> &last = segments_.back();
+      const size_t n = std::min((size_t)(end - begin), last.capacity() - last.size());
+      const size_t old_size = last.size();
+      last.resize(old_size + n);
+      T *out = last.data() + old_size;
+      for (const U *p = begin; p != begin + n; p++) {
+        *out++ = (T)*p;
+      }
+      begin += n;
+    }
+  }
+
+  /*
+   * Sizes the vector for n elements. Only the first segment is
+   * allocated, at most segment_size elements, so that an estimate that
+   * is too large costs little.
+   */
+  void reserve(size_t n) {
+    if (segments_.empty()) {
+      segments_.emplace_back();
+    }
+    if (segments_.size() == 1) {
+      segments_[0].reserve(std::min(n, segment_size));
+    }
+    segments_.reserve((n + segment_mask) >> segment_shift);
+  }
+
+  /*
+   * Releases the spare capacity of the last segment.
+   */
+  void shrink_to_fit() {
+    if (!segments_.empty()) {
+      segments_.back().shrink_to_fit();
+    }
+    segments_.shrink_to_fit();
+  }
+
+  /*
+   * Removes all elements and frees the segments.
+   */
+  void clear() {
+    std::vector<std::vector<T> >().swap(segments_);
+  }
+
+  /*
+   * Calls f(begin, end) on the elements of each segment in order.
+   */
+  template <class F>
+  void for_each_segment(F f) const {
+    for (size_t i = 0; i < segments_.size(); i++) {
+      f(segments_[i].data(), segments_[i].data() + segments_[i].size());
+    }
+  }
+
+  /*
+   * Calls f(begin, end) on the elements of each segment in order, and
+   * frees each segment once f returns. The vector is then empty. At
+   * most one segment is held beyond what f keeps, so moving the
+   * elements to another vector does not double the memory used.
+   */
+  template <class F>
+  void drain(F f) {
+    for (size_t i = 0; i < segments_.size(); i++) {
+      f(segments_[i].data(), segments_[i].data() + segments_[i].size());
+      std::vector<T>().swap(segments_[i]);
+    }
+    clear();
+  }
+
+  /*
+   * Copies the elements to an output iterator, converting each to the
+   * type of the output.
+   */
+  template <class OutputIterator>
+  void copy_to(OutputIterator out) const {
+    for (size_t i = 0; i < segments_.size(); i++) {
+      out = std::copy(segments_[i].begin(), segments_[i].end(), out);
+    }
+  }
+
+private:
+  /*
+   * Ensures the last segment has room for an element. A full segment is
+   * followed by a new one; the first segment doubles until it is full.
+   */
+  void make_room() {
+    if (!segments_.empty() && segments_.back().size() < segments_.back().capacity()) {
+      return;
+    }
+    if (segments_.empty() || segments_.back().size() == segment_size) {
+      segments_.emplace_back();
+      segments_.back().reserve(segments_.size() == 1 ? 1 : segment_size);
+    }
+    else {
+      std::vector<T> &last = segments_.back();
+      last.reserve(std::min(segment_size, std::max((size_t)1, 2 * last.capacity())));
+    }
+  }
+
+  std::vector<std::vector<T> > segments_;
+};
+
+template <class T> const size_t segmented_vector<T>::segment_shift;
+template <class T> const size_t segmented_vector<T>::segment_size;
+template <class T> const size_t segmented_vector<T>::segment_mask;
+
+#endif
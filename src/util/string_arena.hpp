@@ -0,0 +1,159 @@
+/*
+    ParaText: parallel text reading
+    Copyright (C) 2016. wise.io, Inc.
+
+   Licensed to the Apache Software Foundation (ASF) under one
+   or more contributor license agreements.  See the NOTICE file
+   distributed with this work for additional information
+   regarding copyright ownership.  The ASF licenses this file
+   to you under the Apache License, Version 2.0 (the
+   "License"); you may not use this file except in compliance
+   with the License.  You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing,
+   software distributed under the License is distributed on an
+   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+   KIND, either express or implied.  See the License for the
+   specific language governing permissions and limitations
+   under the License.
+ */
+
+#ifndef PARATEXT_STRING_ARENA_HPP
+#define PARATEXT_STRING_ARENA_HPP
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <iterator>
+#include <algorithm>
+
+#include "util/segmented_vector.hpp"
+
+/*
+ * A list of strings stored back to back in segments of bytes of about
+ * 64 KB each, with the offset of each string in the concatenation of
+ * the segments. A string is never split across segments; one longer
+ * than a segment gets a segment of its own. Only the first segment
+ * grows by reallocation, until it is full, so that short lists stay
+ * small.
+ *
+ * The strings are best read in order with for_each(), which walks the
+ * segments sequentially.
+ */
+class string_arena {
+public:
+  static const size_t segment_size = 65536;
+
+  string_arena() {}
+
+  size_t size() const {
+    return offsets_.empty() ? 0 : offsets_.size() - 1;
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  /*
+   * The total length of the strings.
+   */
+  size_t num_bytes() const {
+    return offsets_.empty() ? 0 : offsets_[offsets_.size() - 1];
+  }
+
+  /*
+   * Appends a string given by a range of characters.
+   */
+  template <class Iterator>
+  void push_back(Iterator begin, Iterator end) {
+    const size_t length = std::distance(begin, end);
+    if (offsets_.empty()) {
+      offsets_.push_back(0);
+    }
+    make_room(length);
+    std::vector<char> &last = segments_.back();
+    last.insert(last.end(), begin, end);
+    offsets_.push_back(segment_begins_.back() + last.size());
+  }
+
+  void push_back(const std::string &s) {
+    push_back(s.data(), s.data() + s.size());
+  }
+
+  /*
+   * Returns the i-th string. The segment that holds it is found by a
+   * binary search.
+   */
+  std::string get(size_t i) const {
+    const size_t begin = offsets_[i];
+    const size_t end = offsets_[i + 1];
+    const size_t s = std::upper_bound(segment_begins_.begin(), segment_begins_.end(), begin) - segment_begins_.begin() - 1;
+    const char *data = segments_[s].data() + (begin - segment_begins_[s]);
+    return std::string(data, data + (end - begin));
+  }
+
+  /*
+   * Calls f(begin, end) on the characters of each string in order.
+   */
+  template <class F>
+  void for_each(F f) const {
+    size_t s = 0;
+    for (size_t i = 0; i < size(); i++) {
+      const size_t begin = offsets_[i];
+      const size_t end = offsets_[i + 1];
+      while (s + 1 < segments_.size() && begin >= segment_begins_[s] + segments_[s].size()) {
+        s++;
+      }
+      const char *data = segments_[s].data() + (begin - segment_begins_[s]);
+      f(data, data + (end - begin));
+    }
+  }
+
+  /*
+   * Sizes the offsets for n strings. See segmented_vector::reserve().
+   */
+  void reserve(size_t n) {
+    offsets_.reserve(n + 1);
+  }
+
+  /*
+   * Removes all strings and frees the segments.
+   */
+  void clear() {
+    offsets_.clear();
+    std::vector<std::vector<char> >().swap(segments_);
+    std::vector<size_t>().swap(segment_begins_);
+  }
+
+private:
+  /*
+   * Ensures the last segment has room for a string of a given length.
+   */
+  void make_room(size_t length) {
+    if (segments_.empty()) {
+      segments_.emplace_back();
+      segment_begins_.push_back(0);
+    }
+    std::vector<char> &last = segments_.back();
+    if (last.size() + length <= last.capacity()) {
+      return;
+    }
+    if (last.capacity() < segment_size) {
+      last.reserve(std::max(last.size() + length, std::min((size_t)segment_size, std::max((size_t)64, 2 * last.capacity()))));
+    }
+    else {
+      const size_t begin = segment_begins_.back() + last.size();
+      segments_.emplace_back();
+      segments_.back().reserve(std::max((size_t)segment_size, length));
+      segment_begins_.push_back(begin);
+    }
+  }
+
+  segmented_vector<size_t> offsets_;
+  std::vector<std::vector<char> > segments_;
+  std::vector<size_t> segment_begins_;
+};
+
+#endif
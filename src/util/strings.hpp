@@ -34,7 +34,13 @@
 #include <limits>
 #include <random>
 #include <locale>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
 #include "unicode.hpp"
+#include "fast_double.hpp"
+#include "fast_integer.hpp"
 
   template <class T>
   struct content_hash {};
@@ -139,8 +145,7 @@
     if (!mandatory_quoting) {
       for (Iterator it = begin; it != end; it++) {
 	char c = *it;
-	const std::locale loc("");
-	if (std::isspace(c, loc)) {
+	if (ParaText::is_ascii_space(c)) {
 	  contains_white_space = true;
 	}
     else if (c < 32 || c >= 127) {
@@ -454,8 +459,7 @@
    */
   template <class Iterator>
   inline Iterator eat_whitespace(Iterator begin, Iterator end) {
-    const std::locale loc("");
-    while (begin != end && std::isspace(*begin, loc)) { ++begin; }
+    while (begin != end && ParaText::is_ascii_space(*begin)) { ++begin; }
     return begin;
   }
 
@@ -479,186 +483,170 @@
     return sign ? -val : val;
   }
 
+  /*
+    Returns true if ``c`` introduces the exponent of a floating point
+    number. Besides 'e', the exponent markers of Fortran and Lisp output
+    are accepted.
+   */
+  inline bool is_exponent_marker(char c) {
+    switch (c) {
+    case 'E': case 'e': case 'S': case 's': case 'F': case 'f':
+    case 'D': case 'd': case 'L': case 'l':
+      return true;
+    default:
+      return false;
+    }
+  }
+
   /*
     An STL iterator-based string to floating point number conversion.
-    This function was adapted from the C standard library of RetroBSD,
-    which is based on Berkeley UNIX.
+    The result is the double nearest to the decimal number, with ties
+    broken to even.
+
+    Leading blanks are skipped and parsing stops at the first character
+    that cannot continue the number. An empty token, or a token starting
+    with 'n' or '?', is NaN. A token without digits is zero.
 
-    This function and this function only is BSD license.
-  
-    https://retrobsd.googlecode.com/svn/stable/src/libc/stdlib/strtod.c    
+    The first 19 significant digits are accumulated into a 64-bit
+    integer and converted with ParaText::DecimalToDouble. Only when more
+    digits were given and they decide the rounding is the number rebuilt
+    from all of its digits and passed to the C library.
    */
   template <class Iterator>
-  double bsd_strtod(Iterator begin, Iterator end)
-  {
+  double parse_double(Iterator begin, Iterator end) {
     if (begin == end) {
       return std::numeric_limits<double>::quiet_NaN();
     }
     if (*begin == 'n' || *begin == '?') {
       return std::numeric_limits<double>::quiet_NaN();
     }
-        int sign = 0, expSign = 0, i;
-        double fraction, dblExp;
-        Iterator p = begin;
-        char c;
-
-        /* Exponent read from "EX" field. */
-        int exp = 0;
-
-        /* Exponent that derives from the fractional part.  Under normal
-         * circumstances, it is the negative of the number of digits in F.
-         * However, if I is very long, the last digits of I get dropped
-         * (otherwise a long I with a large negative exponent could cause an
-         * unnecessary overflow on I alone).  In this case, fracExp is
-         * incremented one for each dropped digit. */
-        int fracExp = 0;
-
-        /* Number of digits in mantissa. */
-        int mantSize;
-
-        /* Number of mantissa digits BEFORE decimal point. */
-        int decPt;
-
-        /* Temporarily holds location of exponent in str. */
-        Iterator pExp;
-
-        /* Largest possible base 10 exponent.
-         * Any exponent larger than this will already
-         * produce underflow or overflow, so there's
-         * no need to worry about additional digits. */
-        static int maxExponent = 307;
-
-        /* Table giving binary powers of 10.
-         * Entry is 10^2^i.  Used to convert decimal
-         * exponents into floating-point numbers. */
-        static double powersOf10[] = {
-                1e1, 1e2, 1e4, 1e8, 1e16, 1e32, //1e64, 1e128, 1e256,
-        };
-#if 0
-        static double powersOf2[] = {
-                2, 4, 16, 256, 65536, 4.294967296e9, 1.8446744073709551616e19,
-                //3.4028236692093846346e38, 1.1579208923731619542e77, 1.3407807929942597099e154,
-        };
-        static double powersOf8[] = {
-                8, 64, 4096, 2.81474976710656e14, 7.9228162514264337593e28,
-                //6.2771017353866807638e57, 3.9402006196394479212e115, 1.5525180923007089351e231,
-        };
-        static double powersOf16[] = {
-                16, 256, 65536, 1.8446744073709551616e19,
-                //3.4028236692093846346e38, 1.1579208923731619542e77, 1.3407807929942597099e154,
-        };
-#endif
-
-        /*
-         * Strip off leading blanks and check for a sign.
-         */
-        p = begin;
-        while (p != end && (*p==' ' || *p=='\t'))
-                ++p;
-        if (p != end && *p == '-') {
-                sign = 1;
-                ++p;
-        } else if (p != end && *p == '+')
-                ++p;
-
-        /*
-         * Count the number of digits in the mantissa (including the decimal
-         * point), and also locate the decimal point.
-         */
-        decPt = -1;
-        for (mantSize=0;p != end ; ++mantSize) {
-                c = *p;
-                if (! isdigit (c)) {
-                        if (c != '.' || decPt >= 0)
-                                break;
-                        decPt = mantSize;
-                }
-                ++p;
+    const int max_digits = 19;
+    const long long max_exponent = 100000;
+    Iterator p = begin;
+    while (p != end && (*p == ' ' || *p == '\t')) {
+      ++p;
+    }
+    bool negative = false;
+    if (p != end && *p == '-') {
+      negative = true;
+      ++p;
+    }
+    else if (p != end && *p == '+') {
+      ++p;
+    }
+    const Iterator mantissa_begin = p;
+    uint64_t w = 0;
+    int num_digits = 0;
+    long long exponent = 0;
+    bool truncated = false;
+    while (p != end && *p == '0') {
+      ++p;
+    }
+    for (; p != end && (unsigned)(*p - '0') < 10; ++p) {
+      if (num_digits < max_digits) {
+        w = w * 10 + (*p - '0');
+        num_digits++;
+      }
+      else {
+        truncated = truncated || *p != '0';
+        exponent++;
+      }
+    }
+    if (p != end && *p == '.') {
+      ++p;
+      if (num_digits == 0) {
+        for (; p != end && *p == '0'; ++p) {
+          exponent--;
         }
-
-        /*
-         * Now suck up the digits in the mantissa.  Use two integers to
-         * collect 9 digits each (this is faster than using floating-point).
-         * If the mantissa has more than 18 digits, ignore the extras, since
-         * they can't affect the value anyway.
-         */
-        pExp = p;
-        p -= mantSize;
-        if (decPt < 0)
-                decPt = mantSize;
-        else
-                --mantSize;             /* One of the digits was the point. */
-
-        if (mantSize > 2 * 9)
-                mantSize = 2 * 9;
-        fracExp = decPt - mantSize;
-        if (mantSize == 0) {
-                fraction = 0.0;
-                p = begin;
-                goto done;
-        } else {
-                int frac1, frac2;
-
-                for (frac1=0; mantSize>9 && p != end; --mantSize) {
-                        c = *p++;
-                        if (c == '.')
-                                c = *p++;
-                        frac1 = frac1 * 10 + (c - '0');
-                }
-                for (frac2=0; mantSize>0 && p != end; --mantSize) {
-                        c = *p++;
-                        if (c == '.')
-                                c = *p++;
-                        frac2 = frac2 * 10 + (c - '0');
-                }
-                fraction = (double) 1000000000 * frac1 + frac2;
+      }
+      for (; p != end && (unsigned)(*p - '0') < 10; ++p) {
+        if (num_digits < max_digits) {
+          w = w * 10 + (*p - '0');
+          num_digits++;
+          exponent--;
         }
-
-        /*
-         * Skim off the exponent.
-         */
-        p = pExp;
-        if (p != end && (*p=='E' || *p=='e' || *p=='S' || *p=='s' || *p=='F' || *p=='f' ||
-             *p=='D' || *p=='d' || *p=='L' || *p=='l')) {
-                ++p;
-                if (p != end && *p == '-') {
-                        expSign = 1;
-                        ++p;
-                } else if (p != end && *p == '+')
-                        ++p;
-                while (p != end && isdigit (*p))
-                        exp = exp * 10 + (*p++ - '0');
+        else {
+          truncated = truncated || *p != '0';
+        }
+      }
+    }
+    const Iterator mantissa_end = p;
+    long long explicit_exponent = 0;
+    if (p != end && is_exponent_marker(*p)) {
+      ++p;
+      bool negative_exponent = false;
+      if (p != end && *p == '-') {
+        negative_exponent = true;
+        ++p;
+      }
+      else if (p != end && *p == '+') {
+        ++p;
+      }
+      for (; p != end && *p >= '0' && *p <= '9'; ++p) {
+        if (explicit_exponent < max_exponent) {
+          explicit_exponent = explicit_exponent * 10 + (*p - '0');
         }
-        if (expSign)
-                exp = fracExp - exp;
-        else
-                exp = fracExp + exp;
-
-        /*
-         * Generate a floating-point number that represents the exponent.
-         * Do this by processing the exponent one bit at a time to combine
-         * many powers of 2 of 10. Then combine the exponent with the
-         * fraction.
-         */
-        if (exp < 0) {
-                expSign = 1;
-                exp = -exp;
-        } else
-                expSign = 0;
-        if (exp > maxExponent)
-                exp = maxExponent;
-        dblExp = 1.0;
-        for (i=0; exp; exp>>=1, ++i)
-                if (exp & 01)
-                        dblExp *= powersOf10[i];
-        if (expSign)
-                fraction /= dblExp;
-        else
-                fraction *= dblExp;
-
-done:
-        return sign ? -fraction : fraction;
-}
+      }
+      if (negative_exponent) {
+        explicit_exponent = -explicit_exponent;
+      }
+    }
+    exponent += explicit_exponent;
+    if (!truncated) {
+      return ParaText::DecimalToDouble::convert(w, exponent, negative);
+    }
+    double result = 0.0;
+    if (ParaText::DecimalToDouble::convert_truncated(w, exponent, negative, result)) {
+      return result;
+    }
+    /* Rebuild the number as an integer and a power of ten, which reads the
+       same in every locale. */
+    std::string digits(negative ? "-" : "");
+    long long fraction_digits = 0;
+    bool seen_point = false;
+    for (Iterator it = mantissa_begin; it != mantissa_end; ++it) {
+      if (*it == '.') {
+        seen_point = true;
+      }
+      else {
+        digits.push_back(*it);
+        fraction_digits += seen_point ? 1 : 0;
+      }
+    }
+    digits += "e" + std::to_string(explicit_exponent - fraction_digits);
+    return std::strtod(digits.c_str(), NULL);
+  }
+
+  /*
+    Formats a floating point number with the fewest significant digits
+    that read back as the same number, in fixed notation unless its
+    exponent is below -4 or above 16. If ``single`` is true, the digits
+    need only read back as the same float.
+   */
+  inline std::string format_double(double value, bool single) {
+    if (value != value) {
+      return "nan";
+    }
+    if (value == std::numeric_limits<double>::infinity() || value == -std::numeric_limits<double>::infinity()) {
+      return value > 0 ? "inf" : "-inf";
+    }
+    char buf[40];
+    int precision = 1;
+    for (; precision < 17; precision++) {
+      snprintf(buf, sizeof(buf), "%.*e", precision - 1, value);
+      const double back = std::strtod(buf, NULL);
+      if (single ? (float)back == (float)value : back == value) {
+        break;
+      }
+    }
+    snprintf(buf, sizeof(buf), "%.*e", precision - 1, value);
+    const int exponent = atoi(strchr(buf, 'e') + 1);
+    if (exponent >= precision && exponent <= 16) {
+      precision = exponent + 1;
+    }
+    snprintf(buf, sizeof(buf), "%.*g", precision, value);
+    return buf;
+  }
 
   inline std::string get_quoted_string(const std::string &s) {
     return get_quoted_string(s.begin(), s.end(), false, false);
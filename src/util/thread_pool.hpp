@@ -0,0 +1,252 @@
+/*
+    ParaText: parallel text reading
+    Copyright (C) 2016. wise.io, Inc.
+
+   Licensed to the Apache Software Foundation (ASF) under one
+   or more contributor license agreements.  See the NOTICE file
+   distributed with this work for additional information
+   regarding copyright ownership.  The ASF licenses this file
+   to you under the Apache License, Version 2.0 (the
+   "License"); you may not use this file except in compliance
+   with the License.  You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing,
+   software distributed under the License is distributed on an
+   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+   KIND, either express or implied.  See the License for the
+   specific language governing permissions and limitations
+   under the License.
+ */
+
+
+#ifndef PARATEXT_THREAD_POOL_HPP
+#define PARATEXT_THREAD_POOL_HPP
+
+#include <deque>
+#include <vector>
+#include <functional>
+#include <exception>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace ParaText {
+
+  /*
+    A process-wide pool of worker threads. The loader stages submit
+    their tasks here rather than creating and joining threads of their
+    own, so loads that run back to back reuse the same threads and
+    loads that overlap share them instead of oversubscribing the cores.
+   */
+  class ThreadPool {
+  public:
+    /*
+      Returns the pool, starting it with one thread per core on first use.
+     */
+    static ThreadPool &get_instance() {
+      static ThreadPool pool(std::max(1U, std::thread::hardware_concurrency()));
+      return pool;
+    }
+
+    /*
+      Returns the pool that reads files ahead of the parse workers. It
+      is kept apart from get_instance() because the parse tasks wait on
+      these reads, which must not queue behind them. Its tasks never
+      wait on a consumer, so one thread per core serves every reader.
+     */
+    static ThreadPool &get_io_instance() {
+      static ThreadPool pool(std::max(1U, std::thread::hardware_concurrency()));
+      return pool;
+    }
+
+    /*
+      Stops the worker threads once the queued tasks have run.
+     */
+    virtual ~ThreadPool() {
+      stop();
+    }
+
+    /*
+      Changes the number of worker threads. Queued tasks are run by the
+      old threads before they exit.
+     */
+    void set_num_threads(size_t num_threads) {
+      std::unique_lock<std::mutex> resize_guard(resize_mutex_);
+      stop();
+      start(std::max((size_t)1, num_threads));
+    }
+
+    /*
+      Returns the number of worker threads.
+     */
+    size_t get_num_threads() const {
+      return num_threads_;
+    }
+
+    /*
+      Queues a task to run on a worker thread.
+     */
+    void submit(const std::function<void()> &task) {
+      {
+        std::unique_lock<std::mutex> guard(mutex_);
+        tasks_.push_back(task);
+      }
+      cond_.notify_one();
+    }
+
+    /*
+      Runs one queued task on the calling thread. Returns false if no
+      task was queued.
+     */
+    bool run_pending_task() {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> guard(mutex_);
+        if (tasks_.empty()) {
+          return false;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+      return true;
+    }
+
+  private:
+    explicit ThreadPool(size_t num_threads) : num_threads_(0), stop_(false) {
+      start(num_threads);
+    }
+
+    void start(size_t num_threads) {
+      stop_ = false;
+      num_threads_ = num_threads;
+      for (size_t i = 0; i < num_threads; i++) {
+        threads_.emplace_back(&ThreadPool::work, this);
+      }
+    }
+
+    void stop() {
+      {
+        std::unique_lock<std::mutex> guard(mutex_);
+        stop_ = true;
+      }
+      cond_.notify_all();
+      for (size_t i = 0; i < threads_.size(); i++) {
+        threads_[i].join();
+      }
+      threads_.clear();
+      num_threads_ = 0;
+    }
+
+    void work() {
+      while (true) {
+        std::function<void()> task;
+        {
+          std::unique_lock<std::mutex> guard(mutex_);
+          cond_.wait(guard, [this]() { return stop_ || !tasks_.empty(); });
+          if (tasks_.empty()) {
+            return;
+          }
+          task = std::move(tasks_.front());
+          tasks_.pop_front();
+        }
+        task();
+      }
+    }
+
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+
+  private:
+    std::vector<std::thread> threads_;
+    std::deque<std::function<void()> > tasks_;
+    size_t num_threads_;
+    bool stop_;
+    std::mutex mutex_;
+    std::mutex resize_mutex_;
+    std::condition_variable cond_;
+  };
+
+  /*
+    A set of tasks submitted to a ThreadPool that can be waited on
+    together. The first exception thrown by a task is rethrown by wait().
+   */
+  class TaskGroup {
+  public:
+    explicit TaskGroup(ThreadPool &pool = ThreadPool::get_instance()) : pool_(pool), num_pending_(0) {}
+
+    /*
+      Waits for the tasks that are still running.
+     */
+    virtual ~TaskGroup() {
+      try {
+        wait();
+      }
+      catch (...) {}
+    }
+
+    /*
+      Submits a task to the pool.
+     */
+    void run(const std::function<void()> &task) {
+      {
+        std::unique_lock<std::mutex> guard(mutex_);
+        num_pending_++;
+      }
+      pool_.submit([this, task]() {
+          try {
+            task();
+          }
+          catch (...) {
+            std::unique_lock<std::mutex> guard(mutex_);
+            if (!exception_) {
+              exception_ = std::current_exception();
+            }
+          }
+          std::unique_lock<std::mutex> guard(mutex_);
+          num_pending_--;
+          cond_.notify_all();
+        });
+    }
+
+    /*
+      Waits until every task submitted so far has finished. While it waits,
+      the calling thread runs queued tasks itself, so a task may wait on a
+      group of its own without starving the pool.
+     */
+    void wait() {
+      while (true) {
+        {
+          std::unique_lock<std::mutex> guard(mutex_);
+          if (num_pending_ == 0) {
+            break;
+          }
+        }
+        if (!pool_.run_pending_task()) {
+          std::unique_lock<std::mutex> guard(mutex_);
+          cond_.wait(guard, [this]() { return num_pending_ == 0; });
+        }
+      }
+      std::exception_ptr exception;
+      std::swap(exception, exception_);
+      if (exception) {
+        std::rethrow_exception(exception);
+      }
+    }
+
+  private:
+    TaskGroup(const TaskGroup &);
+    TaskGroup &operator=(const TaskGroup &);
+
+  private:
+    ThreadPool &pool_;
+    size_t num_pending_;
+    std::exception_ptr exception_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+  };
+}
+#endif
@@ -0,0 +1,362 @@
+/*
+    ParaText: parallel text reading
+    Copyright (C) 2016. wise.io, Inc.
+
+   Licensed to the Apache Software Foundation (ASF) under one
+   or more contributor license agreements.  See the NOTICE file
+   distributed with this work for additional information
+   regarding copyright ownership.  The ASF licenses this file
+   to you under the Apache License, Version 2.0 (the
+   "License"); you may not use this file except in compliance
+   with the License.  You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing,
+   software distributed under the License is distributed on an
+   "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+   KIND, either express or implied.  See the License for the
+   specific language governing permissions and limitations
+   under the License.
+ */
+
+#ifndef PARATEXT_TOKEN_CLASSIFIER_HPP
+#define PARATEXT_TOKEN_CLASSIFIER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include "strings.hpp"
+#include "fast_double.hpp"
+#include "fast_integer.hpp"
+
+namespace ParaText {
+
+  /*
+    What TokenClassifier::classify() found in an unquoted token.
+   */
+  typedef enum {SIGNED_INTEGER_TOKEN, UNSIGNED_INTEGER_TOKEN, INTEGER_OVERFLOW_TOKEN,
+                FLOAT_TOKEN, NAN_TOKEN, STRING_TOKEN} TokenKind;
+
+  /*
+    The kind of token a column is expected to hold, as inferred from a
+    sample of the file. ANY_EXPECTED means nothing is known.
+   */
+  typedef enum {ANY_EXPECTED, INTEGER_EXPECTED, FLOAT_EXPECTED, STRING_EXPECTED} ExpectedToken;
+
+  /*
+    Classifies an unquoted token and parses its value in a single pass.
+
+    The token is run through a deterministic automaton whose input is
+    the class of each byte, looked up in a 256-entry table. While the
+    automaton runs, the significant digits and the decimal exponent
+    are accumulated, so an integer or a float is ready when the last
+    byte has been read. The grammar accepted is
+
+       integer:  space* '-'? digit+
+       float:    space* '-'? (digit+ '.'? digit* | '.' digit+)
+                 (('e'|'E') ('+'|'-')? digit+)?
+       NaN:      space* ('?' | 'nan')
+
+    with the case of 'nan' ignored. A float needs a fraction or an
+    exponent, and a trailing '.' with neither (as in "1.") is not a
+    number. A lone '-' is the integer 0, a placeholder some files use
+    for zero. Anything else, including an empty token, is a string.
+   */
+  class TokenClassifier {
+  public:
+    /*
+      Classifies [begin, end). An integer is stored in
+      ``integer_value`` or, if it only fits an unsigned long long, in
+      ``unsigned_value``; a float is stored in ``float_value``.
+     */
+    static TokenKind classify(const char *begin, const char *end,
+                              long long &integer_value,
+                              unsigned long long &unsigned_value,
+                              double &float_value) {
+      const long long max_exponent = 100000;
+      unsigned char state = START;
+      uint64_t w = 0;
+      int num_digits = 0;
+      long long exponent = 0;
+      long long explicit_exponent = 0;
+      bool negative = false;
+      bool negative_exponent = false;
+      bool truncated = false;
+      const char *p = begin;
+      while (p != end) {
+        const unsigned char char_class = get_char_classes()[(unsigned char)*p];
+        state = get_transitions()[state * NUM_CHAR_CLASSES + char_class];
+        if (state == REJECT) {
+          return STRING_TOKEN;
+        }
+        if (char_class != DIGIT_CHAR) {
+          if (char_class == MINUS_CHAR) {
+            negative = negative || state == SIGN;
+            negative_exponent = negative_exponent || state == EXPONENT_SIGN;
+          }
+          ++p;
+        }
+        /* A digit never leaves the state it leads to, so the whole run of
+           digits is consumed here rather than byte by byte above. */
+        else if (state == EXPONENT) {
+          for (; p != end && is_digit(*p); ++p) {
+            if (explicit_exponent < max_exponent) {
+              explicit_exponent = explicit_exponent * 10 + (*p - '0');
+            }
+          }
+        }
+        else {
+          p = read_digits(p, end, state == FRACTION, w, num_digits, exponent, truncated);
+        }
+      }
+      switch (state) {
+      case INTEGER:
+        if (exponent == 0) {
+          if (!negative && w <= (uint64_t)std::numeric_limits<long long>::max()) {
+            integer_value = (long long)w;
+            return SIGNED_INTEGER_TOKEN;
+          }
+          else if (negative && w <= (uint64_t)std::numeric_limits<long long>::max() + 1) {
+            integer_value = (long long)(0 - w);
+            return SIGNED_INTEGER_TOKEN;
+          }
+          else if (!negative) {
+            unsigned_value = w;
+            return UNSIGNED_INTEGER_TOKEN;
+          }
+          return INTEGER_OVERFLOW_TOKEN;
+        }
+        /* More than 19 digits: rare enough to parse again with overflow checks. */
+        switch (parse_integer(begin, end, integer_value, unsigned_value)) {
+        case IntegerKind::SIGNED_INTEGER:
+          return SIGNED_INTEGER_TOKEN;
+        case IntegerKind::UNSIGNED_INTEGER:
+          return UNSIGNED_INTEGER_TOKEN;
+        default:
+          return INTEGER_OVERFLOW_TOKEN;
+        }
+      case FRACTION:
+      case EXPONENT:
+        exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+        if (!truncated) {
+          float_value = DecimalToDouble::convert(w, exponent, negative);
+        }
+        else if (!DecimalToDouble::convert_truncated(w, exponent, negative, float_value)) {
+          float_value = ::parse_double(begin, end);
+        }
+        return FLOAT_TOKEN;
+      case SIGN:
+        integer_value = 0;
+        return SIGNED_INTEGER_TOKEN;
+      case QUESTION_MARK:
+      case NAN_LETTERS:
+        return NAN_TOKEN;
+      default:
+        return STRING_TOKEN;
+      }
+    }
+
+    /*
+      Classifies [begin, end) exactly as classify() does, but first tries
+      the common form of the ``expected`` kind of token: an integer of at
+      most 18 digits, a decimal of at most 19 digits with an exponent of
+      at most 5 digits, or a string that cannot begin a number. A token of that form is
+      parsed without running the automaton. Any other token is
+      classified in full, so an unexpected token only costs time.
+     */
+    static TokenKind classify_expected(ExpectedToken expected,
+                                       const char *begin, const char *end,
+                                       long long &integer_value,
+                                       unsigned long long &unsigned_value,
+                                       double &float_value) {
+      switch (expected) {
+      case ExpectedToken::INTEGER_EXPECTED:
+      case ExpectedToken::FLOAT_EXPECTED:
+        {
+          const bool negative = begin != end && *begin == '-';
+          const char *p = begin + negative;
+          uint64_t w = 0;
+          const char *q = read_plain_digits(p, end, w);
+          if (q == p || q - p > 19) {
+            break;
+          }
+          if (q == end) {
+            if (q - p > 18) {
+              break;
+            }
+            integer_value = negative ? -(long long)w : (long long)w;
+            return SIGNED_INTEGER_TOKEN;
+          }
+          if (expected == ExpectedToken::INTEGER_EXPECTED) {
+            break;
+          }
+          const char *r = q;
+          long long exponent = 0;
+          if (*r == '.') {
+            r = read_plain_digits(q + 1, end, w);
+            if (r == q + 1 || (q - p) + (r - q - 1) > 19) {
+              break;
+            }
+            exponent = -(r - q - 1);
+          }
+          if (r != end && (*r == 'e' || *r == 'E')) {
+            const char *t = r + 1;
+            const bool negative_exponent = t != end && *t == '-';
+            t += t != end && (*t == '-' || *t == '+');
+            long long explicit_exponent = 0;
+            for (r = t; r != end && is_digit(*r) && r - t < 5; ++r) {
+              explicit_exponent = explicit_exponent * 10 + (*r - '0');
+            }
+            if (r == t) {
+              break;
+            }
+            exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+          }
+          else if (r == q) {
+            break;
+          }
+          if (r != end) {
+            break;
+          }
+          float_value = DecimalToDouble::convert(w, exponent, negative);
+          return FLOAT_TOKEN;
+        }
+      case ExpectedToken::STRING_EXPECTED:
+        if (begin == end) {
+          return STRING_TOKEN;
+        }
+        switch (get_char_classes()[(unsigned char)*begin]) {
+        case OTHER_CHAR:
+        case PLUS_CHAR:
+        case EXPONENT_CHAR:
+        case A_CHAR:
+          return STRING_TOKEN;
+        default:
+          break;
+        }
+        break;
+      default:
+        break;
+      }
+      return classify(begin, end, integer_value, unsigned_value, float_value);
+    }
+
+  private:
+    static bool is_digit(char c) {
+      return (unsigned char)(c - '0') < 10;
+    }
+
+    /*
+      Accumulates the run of digits at ``p`` into ``w``, eight at a time
+      while it can, and returns the end of the run. Only the first 19
+      digits are guaranteed to fit; the caller checks the length.
+     */
+    static const char *read_plain_digits(const char *p, const char *end, uint64_t &w) {
+      const char *start = p;
+      while (end - p >= 8 && p - start <= 11) {
+        const uint64_t word = load_eight_bytes(p);
+        if (!is_eight_digits(word)) {
+          break;
+        }
+        w = w * 100000000 + parse_eight_digits(word);
+        p += 8;
+      }
+      for (; p != end && is_digit(*p); ++p) {
+        w = w * 10 + (*p - '0');
+      }
+      return p;
+    }
+
+    /*
+      Accumulates the run of digits at ``p`` into the first 19
+      significant digits ``w`` and the decimal exponent, eight digits at
+      a time while they fit. Returns the end of the run.
+     */
+    static const char *read_digits(const char *p, const char *end, bool fraction,
+                                   uint64_t &w, int &num_digits, long long &exponent, bool &truncated) {
+      const int max_digits = 19;
+      if (num_digits == 0) {
+        /* Leading zeros are not significant, but still shift a fraction. */
+        const char *q = p;
+        for (; q != end && *q == '0'; ++q) {}
+        if (fraction) {
+          exponent -= q - p;
+        }
+        p = q;
+      }
+      while (end - p >= 8 && num_digits <= max_digits - 8) {
+        const uint64_t word = load_eight_bytes(p);
+        if (!is_eight_digits(word)) {
+          break;
+        }
+        w = w * 100000000 + parse_eight_digits(word);
+        num_digits += 8;
+        if (fraction) {
+          exponent -= 8;
+        }
+        p += 8;
+      }
+      for (; p != end && is_digit(*p); ++p) {
+        if (num_digits < max_digits) {
+          w = w * 10 + (*p - '0');
+          num_digits++;
+          exponent -= fraction;
+        }
+        else {
+          truncated = truncated || *p != '0';
+          exponent += !fraction;
+        }
+      }
+      return p;
+    }
+
+    typedef enum {OTHER_CHAR, SPACE_CHAR, DIGIT_CHAR, MINUS_CHAR, PLUS_CHAR, POINT_CHAR,
+                  EXPONENT_CHAR, QUESTION_CHAR, N_CHAR, A_CHAR, NUM_CHAR_CLASSES} CharClass;
+
+    /*
+      The states of the automaton. INTEGER, FRACTION, EXPONENT,
+      QUESTION_MARK and NAN_LETTERS accept; REJECT is a dead state.
+     */
+    typedef enum {START, SIGN, INTEGER, LEADING_POINT, TRAILING_POINT, FRACTION,
+                  EXPONENT_MARKER, EXPONENT_SIGN, EXPONENT, QUESTION_MARK,
+                  N_LETTER, NA_LETTERS, NAN_LETTERS, REJECT, NUM_STATES} State;
+
+    static const unsigned char *get_char_classes() {
+      static const unsigned char classes[256] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 3, 5, 0, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 0, 0, 0, 0, 0, 7,
+        0, 9, 0, 0, 0, 6, 0, 0, 0, 0, 0, 0, 0, 0, 8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 9, 0, 0, 0, 6, 0, 0, 0, 0, 0, 0, 0, 0, 8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+      };
+      return classes;
+    }
+
+    static const unsigned char *get_transitions() {
+      /* One row per state, one column per character class:
+         other, space, digit, '-', '+', '.', 'e', '?', 'n', 'a'. */
+      static const unsigned char transitions[NUM_STATES * NUM_CHAR_CLASSES] = {
+        /* START           */ REJECT, START, INTEGER, SIGN, REJECT, LEADING_POINT, REJECT, QUESTION_MARK, N_LETTER, REJECT,
+        /* SIGN            */ REJECT, REJECT, INTEGER, REJECT, REJECT, LEADING_POINT, REJECT, REJECT, REJECT, REJECT,
+        /* INTEGER         */ REJECT, REJECT, INTEGER, REJECT, REJECT, TRAILING_POINT, EXPONENT_MARKER, REJECT, REJECT, REJECT,
+        /* LEADING_POINT   */ REJECT, REJECT, FRACTION, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT,
+        /* TRAILING_POINT  */ REJECT, REJECT, FRACTION, REJECT, REJECT, REJECT, EXPONENT_MARKER, REJECT, REJECT, REJECT,
+        /* FRACTION        */ REJECT, REJECT, FRACTION, REJECT, REJECT, REJECT, EXPONENT_MARKER, REJECT, REJECT, REJECT,
+        /* EXPONENT_MARKER */ REJECT, REJECT, EXPONENT, EXPONENT_SIGN, EXPONENT_SIGN, REJECT, REJECT, REJECT, REJECT, REJECT,
+        /* EXPONENT_SIGN   */ REJECT, REJECT, EXPONENT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT,
+        /* EXPONENT        */ REJECT, REJECT, EXPONENT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT,
+        /* QUESTION_MARK   */ REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT,
+        /* N_LETTER        */ REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, NA_LETTERS,
+        /* NA_LETTERS      */ REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, NAN_LETTERS, REJECT,
+        /* NAN_LETTERS     */ REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT,
+        /* REJECT          */ REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT
+      };
+      return transitions;
+    }
+  };
+}
+#endif
@@ -33,11 +33,21 @@
 #include <cstdint>
 #include <cmath>
 #include <numeric>
+#include <type_traits>
 
 #include <typeinfo>
 #include <typeindex>
 #include <unordered_map>
 #include <sstream>
+#include <memory>
+#include <stdexcept>
+#include <algorithm>
+
+#include "util/segmented_vector.hpp"
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#endif
 
 template <class Head, class ... Ts>
 struct contains_integral
@@ -79,30 +89,49 @@ static std::string get_type_name(std::type_index idx) {
   }
 }
 
+/*
+ * The type that holds values of both A and B, like std::common_type,
+ * except that float is widened to double when the other type is an
+ * integer that float cannot represent exactly, and a mix of signed and
+ * unsigned integers never yields an unsigned type.
+ */
+template <class A, class B>
+struct exact_common_type {
+  typedef typename std::common_type<A, B>::type common;
+  static const bool mixed_signs = std::is_integral<A>::value && std::is_integral<B>::value
+    && std::is_signed<A>::value != std::is_signed<B>::value && std::is_unsigned<common>::value;
+  typedef typename std::conditional<mixed_signs,
+                                    typename std::conditional<(sizeof(common) < 8), int64_t, double>::type,
+                                    typename std::conditional<std::is_same<common, float>::value
+                                                              && ((std::is_integral<A>::value && sizeof(A) > 2)
+                                                                  || (std::is_integral<B>::value && sizeof(B) > 2)),
+                                                              double, common>::type>::type type;
+};
+
 template <class T>
 static std::type_index get_common_type_index(std::type_index idx) {
   static std::unordered_map<std::type_index, std::type_index>
     common_types({
                   std::make_pair(std::type_index(typeid(uint8_t)),
-                                 std::type_index(typeid(typename std::common_type<T, uint8_t>::type))),
+                                 std::type_index(typeid(typename exact_common_type<T, uint8_t>::type))),
                   std::make_pair(std::type_index(typeid(uint16_t)),
-                                 std::type_index(typeid(typename std::common_type<T, uint16_t>::type))),
+                                 std::type_index(typeid(typename exact_common_type<T, uint16_t>::type))),
                   std::make_pair(std::type_index(typeid(uint32_t)),
-                                 std::type_index(typeid(typename std::common_type<T, uint32_t>::type))),
+                                 std::type_index(typeid(typename exact_common_type<T, uint32_t>::type))),
                   std::make_pair(std::type_index(typeid(uint64_t)),
-                                 std::type_index(typeid(typename std::common_type<T, uint64_t>::type))),
+                                 std::type_index(typeid(typename exact_common_type<T, uint64_t>::type))),
                   std::make_pair(std::type_index(typeid(int8_t)),
-                                 std::type_index(typeid(typename std::common_type<T, int8_t>::type))),
+                                 std::type_index(typeid(typename exact_common_type<T, int8_t>::type))),
                   std::make_pair(std::type_index(typeid(int16_t)),
-                                 std::type_index(typeid(typename std::common_type<T, int16_t>::type))),
+                                 std::type_index(typeid(typename exact_common_type<T, int16_t>::type))),
                   std::make_pair(std::type_index(typeid(int32_t)),
-                                 std::type_index(typeid(typename std::common_type<T, int32_t>::type))),
+                                 std::type_index(typeid(typename exact_common_type<T, int32_t>::type))),
                   std::make_pair(std::type_index(typeid(int64_t)),
-                                 std::type_index(typeid(typename std::common_type<T, int64_t>::type))),
+                                 std::type_index(typeid(typename exact_common_type<T, int64_t>::type))),
                   std::make_pair(std::type_index(typeid(float)),
-                                 std::type_index(typeid(typename std::common_type<T, float>::type))),
+                                 std::type_index(typeid(typename exact_common_type<T, float>::type))),
                   std::make_pair(std::type_index(typeid(double)),
-                                 std::type_index(typeid(typename std::common_type<T, double>::type)))});
+                                 std::type_index(typeid(typename exact_common_type<T, double>::type)))});
   auto it = common_types.find(idx);
   if (it == common_types.end()) {
     std::ostringstream ostr;
@@ -116,19 +145,172 @@ static std::type_index get_common_type_index(std::type_index idx) {
   return it->second;
 }
 
+/*
+ * Finds the least and greatest of a non-empty run of integers.
+ */
+template <class T>
+static inline void get_integer_range(const T *begin, const T *end, T &lo, T &hi) {
+  lo = *begin;
+  hi = *begin;
+  for (const T *p = begin + 1; p != end; p++) {
+    lo = *p < lo ? *p : lo;
+    hi = *p > hi ? *p : hi;
+  }
+}
+
+/*
+ * Finds the least and greatest of a non-empty run of long longs, four
+ * at a time when AVX2 is available.
+ */
+static inline void get_integer_range(const long long *begin, const long long *end, long long &lo, long long &hi) {
+  const long long *p = begin;
+  lo = *p;
+  hi = *p;
+#if defined(__AVX2__)
+  if (end - p >= 8) {
+    __m256i vlo = _mm256_loadu_si256((const __m256i *)p);
+    __m256i vhi = vlo;
+    for (p += 4; end - p >= 4; p += 4) {
+      const __m256i v = _mm256_loadu_si256((const __m256i *)p);
+      vlo = _mm256_blendv_epi8(vlo, v, _mm256_cmpgt_epi64(vlo, v));
+      vhi = _mm256_blendv_epi8(vhi, v, _mm256_cmpgt_epi64(v, vhi));
+    }
+    long long los[4], his[4];
+    _mm256_storeu_si256((__m256i *)los, vlo);
+    _mm256_storeu_si256((__m256i *)his, vhi);
+    for (size_t i = 0; i < 4; i++) {
+      lo = los[i] < lo ? los[i] : lo;
+      hi = his[i] > hi ? his[i] : hi;
+    }
+  }
+#endif
+  for (; p != end; p++) {
+    lo = *p < lo ? *p : lo;
+    hi = *p > hi ? *p : hi;
+  }
+}
+
+/*
+ * Whether the type Head holds every value of a run exactly. These are
+ * the conditions under which a widening vector keeps a value at Head,
+ * checked for a whole run at once: integers against the range of their
+ * least and greatest values, and the others value by value.
+ */
+template <class Head, class T>
+static inline typename std::enable_if<std::is_integral<Head>::value && std::is_integral<T>::value, bool>::type
+holds_exactly(const T *begin, const T *end) {
+  if (begin == end) {
+    return true;
+  }
+  T lo, hi;
+  get_integer_range(begin, end, lo, hi);
+  return (lo >= 0 || (long long)lo >= (long long)std::numeric_limits<Head>::lowest())
+    && (hi <= 0 || (unsigned long long)hi <= (unsigned long long)std::numeric_limits<Head>::max());
+}
+
+template <class Head, class T>
+static inline typename std::enable_if<std::is_integral<Head>::value && std::is_floating_point<T>::value, bool>::type
+holds_exactly(const T *begin, const T *end) {
+  bool held = true;
+  for (const T *p = begin; p != end; p++) {
+    held &= std::trunc(*p) == *p
+      && *p >= (double)std::numeric_limits<Head>::lowest()
+      && *p < (double)std::numeric_limits<Head>::max() + 1.0;
+  }
+  return held;
+}
+
+template <class Head, class T>
+static inline typename std::enable_if<std::is_floating_point<Head>::value && std::is_integral<T>::value && std::is_signed<T>::value, bool>::type
+holds_exactly(const T *begin, const T *end) {
+  bool held = true;
+  for (const T *p = begin; p != end; p++) {
+    const Head converted = (Head)*p;
+    held &= converted >= (Head)std::numeric_limits<long long>::lowest()
+      && converted < -(Head)std::numeric_limits<long long>::lowest()
+      && (long long)converted == (long long)*p;
+  }
+  return held;
+}
+
+template <class Head, class T>
+static inline typename std::enable_if<std::is_floating_point<Head>::value && std::is_integral<T>::value && std::is_unsigned<T>::value, bool>::type
+holds_exactly(const T *begin, const T *end) {
+  bool held = true;
+  for (const T *p = begin; p != end; p++) {
+    const Head converted = (Head)*p;
+    held &= converted < (Head)2 * -(Head)std::numeric_limits<long long>::lowest()
+      && (unsigned long long)converted == (unsigned long long)*p;
+  }
+  return held;
+}
+
+template <class Head, class T>
+static inline typename std::enable_if<std::is_floating_point<Head>::value && std::is_floating_point<T>::value, bool>::type
+holds_exactly(const T *begin, const T *end) {
+  bool held = true;
+  for (const T *p = begin; p != end; p++) {
+    held &= !std::isfinite(*p)
+      || (*p >= std::numeric_limits<Head>::lowest()
+          && *p <= std::numeric_limits<Head>::max()
+          && (double)(Head)*p == *p);
+  }
+  return held;
+}
+
+/*
+ * Whether any of the values is negative.
+ */
+template <class Head>
+static inline typename std::enable_if<std::is_unsigned<Head>::value, bool>::type
+has_negative_values(const segmented_vector<Head> &) {
+  return false;
+}
+
+template <class Head>
+static inline typename std::enable_if<!std::is_unsigned<Head>::value, bool>::type
+has_negative_values(const segmented_vector<Head> &values) {
+  bool negative = false;
+  values.for_each_segment([&negative](const Head *first, const Head *last) {
+      negative = negative || std::any_of(first, last, [](Head v) { return v < 0; });
+    });
+  return negative;
+}
+
+/*
+ * Whether an integer is in the range of the integral type T.
+ */
+template <class T>
+static inline bool integer_fits(long long value) {
+  return value < 0
+    ? std::is_signed<T>::value && value >= (long long)std::numeric_limits<T>::lowest()
+    : (unsigned long long)value <= (unsigned long long)std::numeric_limits<T>::max();
+}
+
+template <class T>
+static inline bool integer_fits(unsigned long long value) {
+  return value <= (unsigned long long)std::numeric_limits<T>::max();
+}
+
 struct widening_vector_impl_base {
   widening_vector_impl_base() {}
   virtual ~widening_vector_impl_base() {}
 
-  virtual widening_vector_impl_base *v_push_back(float f) = 0;
+  virtual widening_vector_impl_base *v_push_back(double f) = 0;
   virtual widening_vector_impl_base *v_push_back(long long f) = 0;
+  virtual widening_vector_impl_base *v_push_back(unsigned long long f) = 0;
+  virtual widening_vector_impl_base *v_append(const double *begin, const double *end) = 0;
+  virtual widening_vector_impl_base *v_append(const long long *begin, const long long *end) = 0;
+  virtual widening_vector_impl_base *v_append(const unsigned long long *begin, const unsigned long long *end) = 0;
 
   virtual void v_shrink_to_fit() = 0;
+  virtual void v_reserve(size_t n) = 0;
   virtual size_t v_size() const = 0;
-  virtual float v_get_float(size_t i) const = 0;
+  virtual double v_get_double(size_t i) const = 0;
   virtual long long v_get_long(size_t i) const = 0;
   virtual void v_clear() = 0;
   virtual std::type_index v_get_type_index() const = 0;
+  virtual bool v_has_negative() const = 0;
   virtual std::type_index v_get_common_type_index(std::type_index idx) const = 0;
 
   virtual void copy_into(uint8_t* array) const = 0;
@@ -200,60 +382,168 @@ struct widening_vector_impl<I, Head, Ts...> : public widening_vector_impl_crtp<w
 
   virtual ~widening_vector_impl() {}
 
-  virtual widening_vector_impl_base *v_push_back(float value) {
-    //    std::cout << "f";
+  virtual widening_vector_impl_base *v_push_back(double value) {
     return v_push_back_impl<Head>(value);
   }
 
   virtual widening_vector_impl_base *v_push_back(long long value) {
-    widening_vector_impl_base *retval = this;
-    //std::cout << "i";
-    if (value >= (long long)std::numeric_limits<Head>::lowest()
-        && value <= (long long)std::numeric_limits<Head>::max()) {
-      values_.push_back(value);
+    return v_push_back_integer_impl<Head>(value);
+  }
+
+  virtual widening_vector_impl_base *v_push_back(unsigned long long value) {
+    return v_push_back_unsigned_impl<Head>(value);
+  }
+
+  virtual widening_vector_impl_base *v_append(const double *begin, const double *end) {
+    return append(begin, end);
+  }
+
+  virtual widening_vector_impl_base *v_append(const long long *begin, const long long *end) {
+    return append(begin, end);
+  }
+
+  virtual widening_vector_impl_base *v_append(const unsigned long long *begin, const unsigned long long *end) {
+    return append(begin, end);
+  }
+
+  /*
+   * Appends a run of values. If Head does not hold all of them, the
+   * narrowest wider type that holds both them and the values already
+   * stored is found first, so the values are moved at most once.
+   * Returns the vector now holding the data.
+   */
+  template <class T>
+  widening_vector_impl_base *append(const T *begin, const T *end) {
+    if (holds_exactly<Head>(begin, end)) {
+      values_.append(begin, end);
+      return this;
     }
-    else {
-      move_to_wider();
-      retval = wider_.v_push_back(value);
+    return wider_.adopt(values_, begin, end);
+  }
+
+  /*
+   * Takes over the values of a narrower vector, followed by a run of
+   * values, if Head holds them all. Otherwise passes them on to the
+   * next type. The narrower vector is freed a segment at a time as its
+   * values are moved.
+   */
+  template <class Narrower, class T>
+  widening_vector_impl_base *adopt(segmented_vector<Narrower> &narrower, const T *begin, const T *end) {
+    bool held = holds_exactly<Head>(begin, end);
+    narrower.for_each_segment([&held](const Narrower *first, const Narrower *last) {
+        held = held && holds_exactly<Head>(first, last);
+      });
+    if (!held) {
+      return wider_.adopt(narrower, begin, end);
     }
-    return retval;
+    values_.reserve(std::max(narrower.capacity(), narrower.size() + (end - begin)));
+    narrower.drain([this](const Narrower *first, const Narrower *last) {
+        values_.append(first, last);
+      });
+    values_.append(begin, end);
+    return this;
   }
 
+  /*
+   * A floating point value is kept at a floating point precision only
+   * if it is represented exactly, so narrowing never loses digits.
+   */
   template <class THead>
-  typename std::enable_if<std::is_floating_point<THead>::value, widening_vector_impl_base *>::type v_push_back_impl(float value) {
+  typename std::enable_if<std::is_floating_point<THead>::value, widening_vector_impl_base *>::type v_push_back_impl(double value) {
     widening_vector_impl_base *retval = this;
     if (!std::isfinite(value) ||
         (value >= std::numeric_limits<THead>::lowest()
-         && value <= std::numeric_limits<THead>::max())) {
+         && value <= std::numeric_limits<THead>::max()
+         && (double)(THead)value == value)) {
       values_.push_back(value);
     }
     else {
-      move_to_wider();
-      retval = wider_.v_push_back(value);
+      retval = move_to_wider()->v_push_back(value);
     }
     return (widening_vector_impl_base*)retval;
   }
 
   template <class THead>
-  typename std::enable_if<!std::is_floating_point<THead>::value, widening_vector_impl_base *>::type v_push_back_impl(float value) {
+  typename std::enable_if<!std::is_floating_point<THead>::value, widening_vector_impl_base *>::type v_push_back_impl(double value) {
     widening_vector_impl_base *retval = this;
     if (std::trunc(value) == value
-        && value >= (float)std::numeric_limits<Head>::lowest()
-        && value <= (float)std::numeric_limits<Head>::max()) {
+        && value >= (double)std::numeric_limits<Head>::lowest()
+        && value < (double)std::numeric_limits<Head>::max() + 1.0) {
       values_.push_back(value);
     }
     else {
-      move_to_wider();
-      retval = wider_.v_push_back(value);
+      retval = move_to_wider()->v_push_back(value);
     }
     return (widening_vector_impl_base*)retval;
   }
 
+  template <class THead>
+  typename std::enable_if<!std::is_floating_point<THead>::value, widening_vector_impl_base *>::type v_push_back_integer_impl(long long value) {
+    widening_vector_impl_base *retval = this;
+    if (value >= 0 ? (unsigned long long)value <= (unsigned long long)std::numeric_limits<Head>::max()
+                   : value >= (long long)std::numeric_limits<Head>::lowest()) {
+      values_.push_back(value);
+    }
+    else {
+      retval = move_to_wider()->v_push_back(value);
+    }
+    return retval;
+  }
+
+  /*
+   * Integers are never rounded: one that a floating point type cannot
+   * represent exactly moves the vector to the next type.
+   */
+  template <class THead>
+  typename std::enable_if<std::is_floating_point<THead>::value, widening_vector_impl_base *>::type v_push_back_integer_impl(long long value) {
+    widening_vector_impl_base *retval = this;
+    const THead converted = (THead)value;
+    if (converted >= (THead)std::numeric_limits<long long>::lowest()
+        && converted < -(THead)std::numeric_limits<long long>::lowest()
+        && (long long)converted == value) {
+      values_.push_back(converted);
+    }
+    else {
+      retval = move_to_wider()->v_push_back(value);
+    }
+    return retval;
+  }
+
+  template <class THead>
+  typename std::enable_if<!std::is_floating_point<THead>::value, widening_vector_impl_base *>::type v_push_back_unsigned_impl(unsigned long long value) {
+    widening_vector_impl_base *retval = this;
+    if (value <= (unsigned long long)std::numeric_limits<Head>::max()) {
+      values_.push_back(value);
+    }
+    else {
+      retval = move_to_wider()->v_push_back(value);
+    }
+    return retval;
+  }
+
+  template <class THead>
+  typename std::enable_if<std::is_floating_point<THead>::value, widening_vector_impl_base *>::type v_push_back_unsigned_impl(unsigned long long value) {
+    widening_vector_impl_base *retval = this;
+    const THead converted = (THead)value;
+    if (converted < (THead)2 * -(THead)std::numeric_limits<long long>::lowest()
+        && (unsigned long long)converted == value) {
+      values_.push_back(converted);
+    }
+    else {
+      retval = move_to_wider()->v_push_back(value);
+    }
+    return retval;
+  }
+
 
   virtual void v_shrink_to_fit() {
     shrink_to_fit();
   }
 
+  virtual void v_reserve(size_t n) {
+    values_.reserve(n);
+  }
+
   /*
    * The number of elements in the vector.
    */
@@ -283,8 +573,8 @@ struct widening_vector_impl<I, Head, Ts...> : public widening_vector_impl_crtp<w
     clear();
   }
 
-  virtual float v_get_float(size_t i) const {
-    return (float)values_[i];
+  virtual double v_get_double(size_t i) const {
+    return (double)values_[i];
   }
 
   virtual long long v_get_long(size_t i) const {
@@ -299,42 +589,58 @@ struct widening_vector_impl<I, Head, Ts...> : public widening_vector_impl_crtp<w
     return std::type_index(typeid(Head));
   }
 
+  virtual bool v_has_negative() const {
+    return has_negative_values(values_);
+  }
+
   template <class T>
   void copy_into_impl(T *output) const {
-    std::copy(values_.begin(), values_.end(), output);
+    values_.copy_to(output);
   }
 
   template <class T>
   T get_sum() const {
-    auto begin = values_.begin();
-    return std::accumulate<decltype(begin)>(values_.begin(), values_.end(), (T)0);
+    T sum = (T)0;
+    values_.for_each_segment([&sum](const Head *first, const Head *last) {
+        sum = std::accumulate(first, last, sum);
+      });
+    return sum;
   }
 
 private:
 
   /*
    * Widens the vector, moving the data to the next widenend vector.
+   * Returns the vector now holding the data, which is wider still if
+   * some value could not be represented exactly by the next type.
    */
-  void move_to_wider() {
-    move_to_wider_impl<Head>();
+  widening_vector_impl_base *move_to_wider() {
+    return move_to_wider_impl<Head>();
   }
 
   template <class THead>
-  typename std::enable_if<std::is_integral<THead>::value, void>::type move_to_wider_impl() {
-    for (size_t i = 0; i < values_.size(); i++) {
-      wider_.v_push_back((long long)values_[i]);
-    }
-    values_.clear();
-    values_.shrink_to_fit();
+  typename std::enable_if<std::is_integral<THead>::value, widening_vector_impl_base *>::type move_to_wider_impl() {
+    typedef typename std::conditional<std::is_unsigned<Head>::value, unsigned long long, long long>::type integer_type;
+    widening_vector_impl_base *target = &wider_;
+    wider_.v_reserve(values_.capacity());
+    values_.drain([&target](const Head *first, const Head *last) {
+        for (const Head *p = first; p != last; p++) {
+          target = target->v_push_back((integer_type)*p);
+        }
+      });
+    return target;
   }
 
   template <class THead>
-  typename std::enable_if<!std::is_integral<THead>::value, void>::type move_to_wider_impl() {
-    for (size_t i = 0; i < values_.size(); i++) {
-      wider_.v_push_back((float)values_[i]);
-    }
-    values_.clear();
-    values_.shrink_to_fit();
+  typename std::enable_if<!std::is_integral<THead>::value, widening_vector_impl_base *>::type move_to_wider_impl() {
+    widening_vector_impl_base *target = &wider_;
+    wider_.v_reserve(values_.capacity());
+    values_.drain([&target](const Head *first, const Head *last) {
+        for (const Head *p = first; p != last; p++) {
+          target = target->v_push_back((double)*p);
+        }
+      });
+    return target;
   }
 
 private:
@@ -348,7 +654,7 @@ private:
 
 private:
   bool active_;
-  std::vector<Head> values_;
+  segmented_vector<Head> values_;
   widening_vector_impl<I-1, Ts...> wider_;
 };
 
@@ -363,8 +669,11 @@ struct widening_vector_impl<1, Head> : public widening_vector_impl_crtp<widening
 
   template <class T>
   inline T get_sum() const {
-    auto begin = values_.begin();
-    return std::accumulate<decltype(begin)>(values_.begin(), values_.end(), (T)0);
+    T sum = (T)0;
+    values_.for_each_segment([&sum](const Head *first, const Head *last) {
+        sum = std::accumulate(first, last, sum);
+      });
+    return sum;
   }
 
   template <class T>
@@ -400,22 +709,61 @@ struct widening_vector_impl<1, Head> : public widening_vector_impl_crtp<widening
     values_.clear();
   }
 
-  virtual widening_vector_impl_base *v_push_back(float val) {
-    values_.push_back(val);
+  virtual widening_vector_impl_base *v_push_back(double val) {
+    push_back_double_impl<Head>(val);
     return (widening_vector_impl_base*)this;
   }
 
   virtual widening_vector_impl_base *v_push_back(long long val) {
+    check_range<Head>(&val, &val + 1);
+    values_.push_back(val);
+    return (widening_vector_impl_base*)this;
+  }
+
+  virtual widening_vector_impl_base *v_push_back(unsigned long long val) {
+    check_range<Head>(&val, &val + 1);
     values_.push_back(val);
     return (widening_vector_impl_base*)this;
   }
 
+  virtual widening_vector_impl_base *v_append(const double *begin, const double *end) {
+    return append(begin, end);
+  }
+
+  virtual widening_vector_impl_base *v_append(const long long *begin, const long long *end) {
+    return append(begin, end);
+  }
+
+  virtual widening_vector_impl_base *v_append(const unsigned long long *begin, const unsigned long long *end) {
+    return append(begin, end);
+  }
+
+  template <class T>
+  widening_vector_impl_base *append(const T *begin, const T *end) {
+    check_range<Head>(begin, end);
+    values_.append(begin, end);
+    return (widening_vector_impl_base*)this;
+  }
+
+  template <class Narrower, class T>
+  widening_vector_impl_base *adopt(segmented_vector<Narrower> &narrower, const T *begin, const T *end) {
+    values_.reserve(std::max(narrower.capacity(), narrower.size() + (end - begin)));
+    narrower.drain([this](const Narrower *first, const Narrower *last) {
+        values_.append(first, last);
+      });
+    return append(begin, end);
+  }
+
   virtual void v_shrink_to_fit() {
     shrink_to_fit();
   }
 
-  virtual float v_get_float(size_t i) const {
-    return (float)values_[i];
+  virtual void v_reserve(size_t n) {
+    values_.reserve(n);
+  }
+
+  virtual double v_get_double(size_t i) const {
+    return (double)values_[i];
   }
 
   virtual long long v_get_long(size_t i) const {
@@ -430,13 +778,62 @@ struct widening_vector_impl<1, Head> : public widening_vector_impl_crtp<widening
     return std::type_index(typeid(Head));
   }
 
+  virtual bool v_has_negative() const {
+    return has_negative_values(values_);
+  }
+
   template <class T>
   void copy_into_impl(T *output) const {
-    std::copy(values_.begin(), values_.end(), output);
+    values_.copy_to(output);
   }
 
 private:
-  std::vector<Head> values_;
+  template <class THead>
+  typename std::enable_if<std::is_floating_point<THead>::value>::type push_back_double_impl(double val) {
+    values_.push_back(val);
+  }
+
+  template <class THead>
+  typename std::enable_if<!std::is_floating_point<THead>::value>::type push_back_double_impl(double val) {
+    check_range<Head>(&val, &val + 1);
+    values_.push_back((Head)val);
+  }
+
+  template <class THead, class T>
+  typename std::enable_if<std::is_floating_point<THead>::value>::type check_range(const T *, const T *) {}
+
+  /*
+   * An integer outside the range of the type would wrap around.
+   */
+  template <class THead, class T>
+  typename std::enable_if<!std::is_floating_point<THead>::value && !std::is_floating_point<T>::value>::type check_range(const T *begin, const T *end) {
+    for (const T *p = begin; p != end; p++) {
+      if (!integer_fits<Head>(*p)) {
+        std::ostringstream ostr;
+        ostr << "The value " << *p << " cannot be stored as " << get_type_name(std::type_index(typeid(Head)));
+        throw std::logic_error(ostr.str());
+      }
+    }
+  }
+
+  /*
+   * A floating point value is truncated toward zero. One outside the
+   * range of the type has no integral value to store.
+   */
+  template <class THead, class T>
+  typename std::enable_if<!std::is_floating_point<THead>::value && std::is_floating_point<T>::value>::type check_range(const T *begin, const T *end) {
+    for (const T *p = begin; p != end; p++) {
+      if (!(std::trunc(*p) >= (double)std::numeric_limits<Head>::lowest()
+            && *p < (double)std::numeric_limits<Head>::max() + 1.0)) {
+        std::ostringstream ostr;
+        ostr << "The value " << *p << " cannot be stored as " << get_type_name(std::type_index(typeid(Head)));
+        throw std::logic_error(ostr.str());
+      }
+    }
+  }
+
+private:
+  segmented_vector<Head> values_;
 };
 
 /*
@@ -467,7 +864,19 @@ public:
   virtual ~widening_vector_dynamic() {
   }
 
-  void push_back(float val) {
+  /*
+   * Stores every value as Q from now on, converting each value to Q
+   * rather than widening. Integers are converted as by a cast. The
+   * vector must be empty.
+   */
+  template <class Q>
+  void set_fixed_type() {
+    fixed_.reset(new widening_vector_impl<1, Q>());
+    first_ = fixed_.get();
+    current_ = first_;
+  }
+
+  void push_back(double val) {
     current_ = current_->v_push_back(val);
   }
 
@@ -475,13 +884,32 @@ public:
     current_ = current_->v_push_back(val);
   }
 
+  void push_back(unsigned long long val) {
+    current_ = current_->v_push_back(val);
+  }
+
+  /*
+   * Appends a run of values with a single call into the current type.
+   */
+  void append(const double *begin, const double *end) {
+    current_ = current_->v_append(begin, end);
+  }
+
+  void append(const long long *begin, const long long *end) {
+    current_ = current_->v_append(begin, end);
+  }
+
+  void append(const unsigned long long *begin, const unsigned long long *end) {
+    current_ = current_->v_append(begin, end);
+  }
+
   size_t size() const {
     return current_->v_size();
   }
 
   template <class Q>
   typename std::enable_if<std::is_floating_point<Q>::value, Q>::type get(size_t i) const {
-    return (Q)current_->v_get_float(i);
+    return (Q)current_->v_get_double(i);
   }
 
   template <class Q>
@@ -504,10 +932,24 @@ public:
     current_->v_shrink_to_fit();
   }
 
+  /*
+   * Sizes the current type for n values. See segmented_vector::reserve().
+   */
+  void reserve(size_t n) {
+    current_->v_reserve(n);
+  }
+
   std::type_index get_type_index() const {
     return current_->v_get_type_index();
   }
 
+  /*
+   * Whether any of the values is negative.
+   */
+  bool has_negative() const {
+    return current_->v_has_negative();
+  }
+
   std::type_index get_common_type_index(std::type_index idx) const {
     return current_->v_get_common_type_index(idx);
   }
@@ -525,6 +967,7 @@ public:
 
 private:
   widening_vector_impl<sizeof...(T), T...> values_;
+  std::unique_ptr<widening_vector_impl_base> fixed_;
   widening_vector_impl_base *first_;
   widening_vector_impl_base *current_;
 };
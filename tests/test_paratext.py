@@ -183,6 +183,40 @@ A.1,3ABC
             actual = paratext.load_csv_to_pandas(fn)
             assert_dictframe_almost_equal(actual, expected)
 
+    def test_number_forms(self):
+        filedata = b"""A,B
+ 7,1.
+-.5,-e5
+1e3,+5
+2.5E-1,nan3
+?,1e
+NaN,.
+"""
+        with generate_tempfile(filedata) as fn:
+            expected = {"A": [7, -0.5, 1000, 0.25, np.nan, np.nan], "B": ["1.", "-e5", "+5", "nan3", "1e", "."]}
+            logging.debug("filename: %s" % fn)
+            actual = paratext.load_csv_to_pandas(fn)
+            assert_dictframe_almost_equal(actual, expected)
+
+    def do_dash_placeholder(self, number_only, num_threads):
+        filedata = "A,B\n"
+        expected = {"A": [], "B": []}
+        for row in range(200):
+            dash = row % 7 == 3
+            filedata += "%s,%s\n" % ("-" if dash else "%d" % row, " -" if row % 5 == 0 else "-%d" % row)
+            expected["A"].append(0 if dash else row)
+            expected["B"].append(0 if row % 5 == 0 else -row)
+        with generate_tempfile(filedata.encode("utf-8")) as fn:
+            actual = paratext.load_csv_to_pandas(fn, num_threads=num_threads, number_only=number_only)
+            assert np.issubdtype(actual["A"].dtype, np.integer)
+            assert np.issubdtype(actual["B"].dtype, np.integer)
+            assert_dictframe_almost_equal(actual, expected)
+
+    def test_dash_placeholder(self):
+        for number_only in [False, True]:
+            for num_threads in [1,2,3,5,10]:
+                yield self.do_dash_placeholder, number_only, num_threads
+
 class TestSimpleFiles:
 
     def do_simple_file_suite(self, dataset_metadata, frame_encoding, num_threads, expected_df):
@@ -203,3 +237,372 @@ class TestSimpleFiles:
             for num_threads in [1,2,3,5,10]:
                 for frame_encoding in ["utf-8", "unknown"]:
                     yield self.do_simple_file_suite, dataset_metadata, frame_encoding, num_threads, expected_df
+
+class TestIOMethods:
+
+    def do_io_method(self, filename, io_method, num_threads):
+        expected_df = paratext.load_csv_to_pandas(filename, allow_quoted_newlines=True, num_threads=num_threads)
+        actual_df = paratext.load_csv_to_pandas(filename, allow_quoted_newlines=True, num_threads=num_threads, io_method=io_method)
+        assert_dictframe_almost_equal(actual_df, expected_df)
+
+    def test_io_methods(self):
+        for filename in ["tests/hepatitis.csv", "tests/breast-w.csv"]:
+            for io_method in ["mmap", "async", "direct"]:
+                for num_threads in [1,2,3,5,10]:
+                    yield self.do_io_method, filename, io_method, num_threads
+
+class TestFloatPrecision:
+
+    def do_float_precision(self, float_precision, num_threads):
+        filedata = "A,B,C\n"
+        expected = {"A": [], "B": [], "C": []}
+        for row in range(1000):
+            a = row / 8.0
+            b = float(repr(np.random.random()))
+            c = row * 1000003
+            filedata += "%r,%r,%d\n" % (a, b, c)
+            expected["A"].append(a)
+            expected["B"].append(b)
+            expected["C"].append(c)
+        with generate_tempfile(filedata.encode("utf-8")) as fn:
+            actual = paratext.load_csv_to_pandas(fn, num_threads=num_threads, float_precision=float_precision)
+            if float_precision == "float32":
+                assert actual["A"].dtype == np.float32
+                assert actual["B"].dtype == np.float32
+            elif float_precision == "lossless":
+                assert actual["A"].dtype == np.float32
+                assert actual["B"].dtype == np.float64
+                assert (actual["B"].values == np.asarray(expected["B"])).all()
+            else:
+                assert actual["A"].dtype == np.float64
+                assert actual["B"].dtype == np.float64
+                assert (actual["B"].values == np.asarray(expected["B"])).all()
+            assert (actual["C"].values == np.asarray(expected["C"])).all()
+            assert_dictframe_almost_equal(actual, expected)
+
+    def test_float_precision(self):
+        for float_precision in ["float32", "lossless", "float64"]:
+            for num_threads in [1,2,3,5,10]:
+                yield self.do_float_precision, float_precision, num_threads
+
+class TestLargeIntegers:
+
+    def do_large_integers(self, num_threads):
+        filedata = "A,B,C\n"
+        expected = {"A": [], "B": [], "C": []}
+        for row in range(1000):
+            a = 2**63 + row * 7919
+            b = -2**63 + row
+            c = "%d" % (10**24 + row)
+            filedata += "%d,%d,%s\n" % (a, b, c)
+            expected["A"].append(a)
+            expected["B"].append(b)
+            expected["C"].append(c)
+        with generate_tempfile(filedata.encode("utf-8")) as fn:
+            actual = paratext.load_csv_to_pandas(fn, num_threads=num_threads, out_encoding="utf-8")
+            assert actual["A"].dtype == np.uint64
+            assert actual["B"].dtype == np.int64
+            assert (actual["A"].values == np.asarray(expected["A"], dtype=np.uint64)).all()
+            assert (actual["B"].values == np.asarray(expected["B"], dtype=np.int64)).all()
+            assert list(actual["C"].astype(str)) == expected["C"]
+
+    def test_large_integers(self):
+        for num_threads in [1,2,3,5,10]:
+            yield self.do_large_integers, num_threads
+
+    def do_ids_cross_2_63(self, num_threads):
+        expected = [1000 + i for i in range(400)] + [2**63 + 1 + i for i in range(400)]
+        filedata = "A\n" + "".join("%d\n" % a for a in expected)
+        with generate_tempfile(filedata.encode("utf-8")) as fn:
+            actual = paratext.load_csv_to_pandas(fn, num_threads=num_threads)
+            assert actual["A"].dtype == np.uint64
+            assert (actual["A"].values == np.asarray(expected, dtype=np.uint64)).all()
+
+    def test_ids_cross_2_63(self):
+        for num_threads in [1,2,3,5,10]:
+            yield self.do_ids_cross_2_63, num_threads
+
+    def do_numbers_become_strings(self, num_threads):
+        filedata = "A,B\n"
+        expected = {"A": [], "B": []}
+        for row in range(400):
+            a = 2**53 + 1 + row
+            b = "%g" % (row / 4.0)
+            filedata += "%d,%s\n" % (a, b)
+            expected["A"].append("%d" % a)
+            expected["B"].append(b)
+        filedata += "%d,x\n" % (10**24)
+        expected["A"].append("%d" % (10**24))
+        expected["B"].append("x")
+        with generate_tempfile(filedata.encode("utf-8")) as fn:
+            actual = paratext.load_csv_to_pandas(fn, num_threads=num_threads, out_encoding="utf-8")
+            assert list(actual["A"].astype(str)) == expected["A"]
+            assert list(actual["B"].astype(str)) == expected["B"]
+
+    def test_numbers_become_strings(self):
+        for num_threads in [1,2,3,5,10]:
+            yield self.do_numbers_become_strings, num_threads
+
+    def do_ids_with_empty_fields(self, num_threads):
+        ids = [-8136752378704925907 + row * 7919 for row in range(4000)]
+        filedata = "A,B\n"
+        expected = {"A": [], "B": []}
+        for row in range(4000):
+            a = "" if row == 3000 else "%d" % ids[row]
+            b = "%d" % (10**20 - 1) if row == 10 else a
+            filedata += "%s,%s\n" % (a, b)
+            expected["A"].append(0 if row == 3000 else ids[row])
+            expected["B"].append(b)
+        with generate_tempfile(filedata.encode("utf-8")) as fn:
+            actual = paratext.load_csv_to_pandas(fn, num_threads=num_threads, out_encoding="utf-8")
+            assert actual["A"].dtype == np.int64
+            assert (actual["A"].values == np.asarray(expected["A"], dtype=np.int64)).all()
+            assert list(actual["B"].astype(str)) == expected["B"]
+
+    def test_ids_with_empty_fields(self):
+        for num_threads in [1,2,3,4,5,10,16]:
+            yield self.do_ids_with_empty_fields, num_threads
+
+class TestEmptyFields:
+
+    def do_empty_fields(self, num_threads):
+        filedata = "A,B,C,D\n"
+        expected = {"A": [], "B": [], "C": [], "D": []}
+        for row in range(300):
+            missing = row % 10 in (0, 4, 9)
+            a = "" if missing else "%d" % row
+            b = "" if missing else "cat%d" % (row % 5)
+            c = "" if row < 150 else "%d" % row
+            d = "" if missing else "%g" % (row / 4.0)
+            filedata += "%s,%s,%s,%s\n" % (a, b, c, d)
+            expected["A"].append(0 if missing else row)
+            expected["B"].append(b)
+            expected["C"].append(0 if row < 150 else row)
+            expected["D"].append(np.nan if missing else row / 4.0)
+        with generate_tempfile(filedata.encode("utf-8")) as fn:
+            actual = paratext.load_csv_to_pandas(fn, num_threads=num_threads, out_encoding="utf-8")
+            assert np.issubdtype(actual["A"].dtype, np.integer)
+            assert np.issubdtype(actual["C"].dtype, np.integer)
+            assert_dictframe_almost_equal(actual, expected)
+
+    def test_empty_fields(self):
+        for num_threads in [1,2,3,5,10,20,37]:
+            yield self.do_empty_fields, num_threads
+
+class TestDialects:
+
+    def do_dialect(self, delimiter, escape_style, num_threads):
+        names = ["A", "B", "C"]
+        expected = {"A": [], "B": [], "C": []}
+        for row in range(500):
+            expected["A"].append(row)
+            expected["B"].append(row / 4.0)
+            expected["C"].append(["plain", "a,b|c;d\te", 'say "hi"', "back\\slash"][row % 4])
+        if escape_style == "doubled":
+            quote = lambda s: '"' + s.replace('"', '""') + '"'
+        else:
+            quote = lambda s: '"' + s.replace("\\", "\\\\").replace('"', '\\"') + '"'
+        filedata = delimiter.join(names) + "\n"
+        for row in range(500):
+            filedata += delimiter.join(["%d" % expected["A"][row], "%r" % expected["B"][row], quote(expected["C"][row])]) + "\n"
+        with generate_tempfile(filedata.encode("utf-8")) as fn:
+            actual = paratext.load_csv_to_pandas(fn, num_threads=num_threads, out_encoding="utf-8", delimiter=delimiter, escape_style=escape_style)
+            assert_dictframe_almost_equal(actual, expected)
+
+    def test_dialects(self):
+        for delimiter in [",", "\t", "|", ";"]:
+            for escape_style in ["backslash", "doubled"]:
+                for num_threads in [1,2,3,5,10]:
+                    yield self.do_dialect, delimiter, escape_style, num_threads
+
+    def do_escaped_newlines(self, num_threads):
+        filedata = "A,B\n"
+        expected = {"A": [], "B": []}
+        for row in range(200):
+            newline = "\n" if row % 2 else "\r\n"
+            filedata += '%d,"%s"\n' % (row, ("\\" + newline) * (1 + row % 4) + "end")
+            expected["A"].append(row)
+            expected["B"].append(newline * (1 + row % 4) + "end")
+        with generate_tempfile(filedata.encode("utf-8")) as fn:
+            actual = paratext.load_csv_to_pandas(fn, num_threads=num_threads, out_encoding="utf-8", allow_quoted_newlines=True, escape_style="backslash")
+            assert_dictframe_almost_equal(actual, expected)
+
+    def test_escaped_newlines(self):
+        for num_threads in [1,2,3,5,10]:
+            yield self.do_escaped_newlines, num_threads
+
+class TestQuotedNewlines:
+
+    def do_parse_rounds(self, num_threads):
+        words = ["a", "b b", "1", 'x\\"y']
+        filedata = "A,B,C\n"
+        expected = {"A": [], "B": [], "C": []}
+        for row in range(3000):
+            lines = [",".join(words[(row + k + j) % 4] for j in range(1 + (row * 7 + k) % 6)) for k in range(1 + row % 4)]
+            filedata += '%d,"%s",%d\n' % (row, "\n".join(lines), row * 3)
+            expected["A"].append(row)
+            expected["B"].append("\n".join(lines).replace('\\"', '"'))
+            expected["C"].append(row * 3)
+        with generate_tempfile(filedata.encode("utf-8")) as fn:
+            loader = paratext.internal_create_csv_loader(fn, num_threads=num_threads, allow_quoted_newlines=True, block_size=256, out_encoding="utf-8")
+            assert loader.get_num_parse_rounds() <= 2
+            actual = paratext.load_csv_to_pandas(fn, num_threads=num_threads, allow_quoted_newlines=True, block_size=256, out_encoding="utf-8")
+            assert_dictframe_almost_equal(actual, expected)
+
+    def test_parse_rounds(self):
+        for num_threads in [1,2,4,8,16]:
+            yield self.do_parse_rounds, num_threads
+
+class TestUsecols:
+
+    def do_usecols(self, usecols, num_threads):
+        names = ["A", "B", "C", "D"]
+        columns = {"A": [], "B": [], "C": [], "D": []}
+        filedata = ",".join(names) + "\n"
+        for row in range(500):
+            values = [row, row / 8.0, ["x", "y,z", 'q "r"'][row % 3], -row]
+            for name, value in zip(names, values):
+                columns[name].append(value)
+            filedata += "%d,%r,\"%s\",%d\n" % (values[0], values[1], values[2].replace('"', '\\"'), values[3])
+        selected = [name for (i, name) in enumerate(names) if name in usecols or i in usecols]
+        expected = dict((name, columns[name]) for name in selected)
+        with generate_tempfile(filedata.encode("utf-8")) as fn:
+            actual = paratext.load_csv_to_pandas(fn, num_threads=num_threads, out_encoding="utf-8", usecols=usecols)
+            assert list(actual.columns) == selected
+            assert_dictframe_almost_equal(actual, expected)
+
+    def test_usecols(self):
+        for usecols in [["A"], ["D", "B"], [2], [0, "C", 3]]:
+            for num_threads in [1,2,3,5,10]:
+                yield self.do_usecols, usecols, num_threads
+
+class TestRowFilters:
+
+    def do_row_filters(self, filters, keep, num_threads):
+        names = ["id", "day", "score"]
+        rows = []
+        for row in range(600):
+            rows.append((row, "2024-%02d-%02d" % (row % 12 + 1, row % 28 + 1), row / 4.0 - 50))
+        filedata = ",".join(names) + "\n"
+        for (i, day, score) in rows:
+            filedata += "%d,\"%s\",%r\n" % (i, day, score)
+        kept = [r for r in rows if keep(r)]
+        expected = {"id": [r[0] for r in kept], "day": [r[1] for r in kept], "score": [r[2] for r in kept]}
+        with generate_tempfile(filedata.encode("utf-8")) as fn:
+            actual = paratext.load_csv_to_pandas(fn, num_threads=num_threads, out_encoding="utf-8", filters=filters)
+            assert len(actual) == len(kept)
+            if len(kept) > 0:
+                assert_dictframe_almost_equal(actual, expected)
+
+    def test_row_filters(self):
+        cases = [([("day", ">=", "2024-03-01"), ("day", "<", "2024-05-01")], lambda r: "2024-03-01" <= r[1] < "2024-05-01"),
+                 ([("score", ">", 60)], lambda r: r[2] > 60),
+                 ([[("id", "==", 7)], [("id", "==", 500), ("score", "<", 0)], [("id", ">=", 590)]], lambda r: r[0] == 7 or r[0] >= 590),
+                 ([("id", "<", 0)], lambda r: False)]
+        for (filters, keep) in cases:
+            for num_threads in [1,2,3,5,10]:
+                yield self.do_row_filters, filters, keep, num_threads
+
+class TestRowLimits:
+
+    def do_row_limits(self, skiprows, nrows, io_method, num_threads):
+        filedata = "A,B\n"
+        expected = {"A": [], "B": []}
+        for row in range(300):
+            text = ["plain", "two\nlines", 'a "quote"'][row % 3]
+            filedata += "%d,\"%s\"\n" % (row, text.replace('"', '\\"'))
+            expected["A"].append(row)
+            expected["B"].append(text)
+        stop = 300 if nrows is None else min(300, skiprows + nrows)
+        expected = {"A": expected["A"][skiprows:stop], "B": expected["B"][skiprows:stop]}
+        with generate_tempfile(filedata.encode("utf-8")) as fn:
+            actual = paratext.load_csv_to_pandas(fn, num_threads=num_threads, out_encoding="utf-8", allow_quoted_newlines=True, skiprows=skiprows, nrows=nrows, io_method=io_method)
+            assert len(actual) == len(expected["A"])
+            if len(expected["A"]) > 0:
+                assert_dictframe_almost_equal(actual, expected)
+
+    def test_row_limits(self):
+        for (skiprows, nrows) in [(0, 0), (0, 1), (0, 10), (7, None), (7, 20), (290, 50), (400, None)]:
+            for io_method in ["buffered", "mmap"]:
+                for num_threads in [1,2,3,5,10]:
+                    yield self.do_row_limits, skiprows, nrows, io_method, num_threads
+
+class TestSchemaSamples:
+
+    def do_schema_samples(self, num_threads):
+        filedata = "A,B,C,D\n"
+        for row in range(3000):
+            a = "%d" % (row * 37 - 5000)
+            b = "%.3f" % (row / 7.0) if row % 500 != 499 else "1.5e-3"
+            c = ["red", "green", "3", "nan"][row % 4] if row > 2000 else "blue"
+            d = "%d" % row if row < 2900 else "x%d" % row
+            filedata += "%s,%s,%s,%s\n" % (a, b, c, d)
+        with generate_tempfile(filedata.encode("utf-8")) as fn:
+            expected = paratext.load_csv_to_pandas(fn, num_threads=num_threads, block_size=64, schema_samples=0, out_encoding="utf-8")
+            actual = paratext.load_csv_to_pandas(fn, num_threads=num_threads, block_size=64, schema_samples=8, out_encoding="utf-8")
+            assert_dictframe_almost_equal(actual, expected)
+
+    def test_schema_samples(self):
+        for num_threads in [1,2,3,5,10]:
+            yield self.do_schema_samples, num_threads
+
+class TestDtypes:
+
+    def do_dtypes(self, dtypes, num_threads):
+        filedata = "A,B,C\n"
+        for row in range(500):
+            filedata += "%d,%d,%r\n" % (row % 100, row * 1000, row / 4.0)
+        with generate_tempfile(filedata.encode("utf-8")) as fn:
+            expected = paratext.load_csv_to_pandas(fn, num_threads=num_threads, float_precision="float64")
+            actual = paratext.load_csv_to_pandas(fn, num_threads=num_threads, float_precision="float64", dtypes=dtypes)
+            for name in expected.columns:
+                if name in dtypes:
+                    assert actual[name].dtype == np.dtype(dtypes[name])
+                    assert (actual[name].values == expected[name].values.astype(dtypes[name])).all()
+                else:
+                    assert actual[name].dtype == expected[name].dtype
+
+    def test_dtypes(self):
+        for dtypes in [{"A": "int32"}, {"A": "float64", "B": "int64"}, {"B": np.float32, "C": "float32"}]:
+            for num_threads in [1,2,3,5,10]:
+                yield self.do_dtypes, dtypes, num_threads
+
+    def do_dtype_rejects(self, token, dtype, num_threads):
+        filedata = "A,B\n"
+        for row in range(500):
+            filedata += "%d,%d\n" % (row, row)
+        filedata += "%s,1\n" % token
+        with generate_tempfile(filedata.encode("utf-8")) as fn:
+            try:
+                paratext.load_csv_to_pandas(fn, num_threads=num_threads, dtypes={"A": dtype})
+            except RuntimeError as e:
+                assert "cannot be stored as" in str(e)
+            else:
+                assert False, "%s was stored as %s" % (token, dtype)
+
+    def test_dtype_rejects(self):
+        for token, dtype in [("3000000000", "int32"), ("3e9", "int32"), ("-1", "uint8"),
+                             ("18446744073709551615", "int64"), ("abc", "int32"), ("abc", "float64")]:
+            for num_threads in [1,2,3,5,10]:
+                yield self.do_dtype_rejects, token, dtype, num_threads
+
+    def do_dtype_missing(self, dtype, num_threads):
+        filedata = "A,B\n"
+        markers = ["", "?", "nan", "NaN"]
+        for row in range(500):
+            filedata += "%s,%d\n" % (markers[row % 4] if row % 3 == 0 else str(row), row)
+        with generate_tempfile(filedata.encode("utf-8")) as fn:
+            df = paratext.load_csv_to_pandas(fn, num_threads=num_threads, dtypes={"A": dtype})
+            assert df["A"].dtype == np.dtype(dtype)
+            for row in range(500):
+                if row % 3 != 0:
+                    assert df["A"][row] == row
+                elif np.dtype(dtype).kind == "f":
+                    assert np.isnan(df["A"][row])
+                else:
+                    assert df["A"][row] == 0
+
+    def test_dtype_missing(self):
+        for dtype in ["int16", "uint32", "int64", "float32", "float64"]:
+            for num_threads in [1,2,3,5,10]:
+                yield self.do_dtype_missing, dtype, num_threads